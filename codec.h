@@ -0,0 +1,18 @@
+#ifndef CODEC_H
+#define CODEC_H
+#include <stdint.h>
+/*
+    Codec tables made ahead of time from a dictionary file by create_codec, into codec.c,
+    and compiled into a server built with CODEC defined. codec_source is the dictionary
+    file they were made from; the tables are only used while the file still matches.
+    codec_packed and codec_table are laid out as the codebook's packed and decoding
+    tables, for the first and second level widths given.
+*/
+extern const int codec_source_length;
+extern const unsigned char codec_source[];
+extern const int codec_decode_bits;
+extern const int codec_decode_sub_bits;
+extern const uint64_t codec_packed[256];
+extern const uint32_t codec_table_size;
+extern const uint32_t codec_table[];
+#endif
\ No newline at end of file
@@ -1,35 +1,73 @@
 #include "compression.h"
 #include "message_handling.h"
+#include "byteswap_compat.h"
 #include <sys/stat.h>
 #include <math.h>
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
+#ifdef CODEC
+#include "codec.h"
+#endif
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Input bits indexing the first level decoding table.
+#define DECODE_BITS 10
+// Widest second level table, so codes of up to DECODE_BITS + DECODE_SUB_BITS bits use tables.
+#define DECODE_SUB_BITS 14
+// Most decoding table entries for a canonical dictionary, beyond which it is decoded canonically.
+#define DECODE_TABLE_MOST 65536
+// Marks a first level entry that points to a second level table.
+#define DECODE_LINK 0x80000000U
+// Longest code the encoder's 64 bit accumulator takes in one go.
+#define ENCODE_LONGEST 56
+#ifdef CODEC
+// The map made from the compiled in tables, whose codebook is the compiled in one.
+static m_node * builtin_map = NULL;
+#endif
 /*
-    Interpret the compression dictionary as a map data structure. Store in thread
-    pool structure.
+    Read a whole dictionary file. If it cannot be read the error is printed, and
+    the server exits unless told not to, in which case NULL is returned.
 */
-void create_map(m_node ** compressor) {
-    (*compressor) = malloc(256 * sizeof(m_node));
-    int fd = open("(sample)compression.dict", O_RDONLY);
+static unsigned char * read_dict(const char * path, int * size, int fatal) {
+    int fd = open(path, O_RDONLY);
     if (fd == -1) {
         perror("Failed to open compression dictionary");
-        exit(1);
+        if (fatal) {
+            exit(1);
+        }
+        return NULL;
     }
     struct stat st;
-    if (stat("(sample)compression.dict", &st) == -1) {
+    if (fstat(fd, &st) == -1) {
         close(fd);
         perror("Failed to stat compression dictionary");
-        exit(1);
+        if (fatal) {
+            exit(1);
+        }
+        return NULL;
     }
-    int size = st.st_size;
-    unsigned char * buffer = malloc(size);
+    *size = st.st_size;
+    unsigned char * buffer = malloc(*size);
     if (!buffer) {
         close(fd);
         perror("Failed to allocate memory for compression dictionary");
-        exit(1);
+        if (fatal) {
+            exit(1);
+        }
+        return NULL;
     }
-    read(fd, buffer, size);
+    read(fd, buffer, *size);
     close(fd);
+    return buffer;
+}
+/*
+    Interpret a dictionary file's bytes as a map.
+*/
+static void parse_map(m_node ** compressor, const unsigned char * buffer) {
+    (*compressor) = malloc(256 * sizeof(m_node));
     int count = 0;
     unsigned char curr = 0x00;
     int current_byte = 0;
@@ -72,91 +110,888 @@ void create_map(m_node ** compressor) {
         count++;
         curr++;
     }
+}
+/*
+    Interpret the compression dictionary as a map data structure. Store in thread
+    pool structure. A server built with the codec tables of this dictionary compiled
+    in takes the codes from them, and only parses the file if it has changed since.
+*/
+void create_map(m_node ** compressor) {
+#ifdef CODEC
+    int size;
+    unsigned char * buffer = read_dict("(sample)compression.dict", &size, 1);
+    int same = size == codec_source_length && memcmp(buffer, codec_source, size) == 0;
     free(buffer);
-    
+    if (same && codec_decode_bits == DECODE_BITS && codec_decode_sub_bits == DECODE_SUB_BITS) {
+        (*compressor) = malloc(256 * sizeof(m_node));
+        for (int i = 0; i < 256; i++) {
+            int len = codec_packed[i] & 0xff;
+            (*compressor)[i].byte = i;
+            (*compressor)[i].code_l = len;
+            (*compressor)[i].code = malloc(len);
+            for (int j = 0; j < len; j++) {
+                (*compressor)[i].code[j] = (codec_packed[i] >> (8 + len - 1 - j)) & 1;
+            }
+        }
+        builtin_map = *compressor;
+        return;
+    }
+#endif
+    load_map(compressor, "(sample)compression.dict");
 }
-void decompress(message ** input, m_node ** dict) {
-    unsigned char * new_representation = NULL;
-    u_int8_t * buffer = NULL;
-    int count = 0;
-    int rep_size = 0;
-    int total_bits = (((*input)->length - 1) * 8) - ((u_int8_t) (*input)->buffer[(*input)->length - 1]);
-    int curr_bits = 0;
-    for (int i = 0; i < (*input)->length; i++) {
-        for (int j = 8; j > 0; j--) {
-            count++;
-            buffer = realloc(buffer, sizeof(int) * count);
-            buffer[count - 1] = ((*input)->buffer[i] & ( 1 << (j - 1) )) >> (j - 1);
-            for (int q = 0; q < 256; q++) {
-                if ((*dict)[q].code_l == count) {
-                    if (memcmp((*dict)[q].code, buffer, count) == 0) {
-                        rep_size++;
-                        new_representation = realloc(new_representation, rep_size);
-                        new_representation[rep_size - 1] = (*dict)[q].byte;
-                        count = 0;
-                        free(buffer);
-                        buffer = NULL;
-                        break;
-                    }
+/*
+    Parse the dictionary file at path into a map.
+*/
+void load_map(m_node ** compressor, const char * path) {
+    int size;
+    unsigned char * buffer = read_dict(path, &size, 1);
+    parse_map(compressor, buffer);
+    free(buffer);
+}
+/*
+    Parse the dictionary file at path into a map, for a server already running: a file
+    that cannot be read, or is too short for the codes it gives, is turned away with
+    -1 instead of ending the server.
+*/
+int read_map(m_node ** compressor, const char * path) {
+    int size;
+    unsigned char * buffer = read_dict(path, &size, 0);
+    if (buffer == NULL) {
+        return -1;
+    }
+    uint64_t bits = 0;
+    for (int i = 0; i < 256; i++) {
+        if (bits + 8 > (uint64_t) size * 8) {
+            free(buffer);
+            return -1;
+        }
+        int at = bits / 8;
+        int shift = bits % 8;
+        int len = ((buffer[at] << shift) | (shift > 0 && at + 1 < size ? buffer[at + 1] >> (8 - shift) : 0)) & 0xff;
+        bits += 8 + len;
+    }
+    if (bits > (uint64_t) size * 8) {
+        free(buffer);
+        return -1;
+    }
+    parse_map(compressor, buffer);
+    free(buffer);
+    return 0;
+}
+/*
+    Release a map and the codes it holds.
+*/
+void free_map(m_node * map) {
+    for (int i = 0; i < 256; i++) {
+        free(map[i].code);
+    }
+    free(map);
+}
+/*
+    The decoding state of a canonical dictionary, one whose codes are numbered in order of
+    length and then byte, each length's codes following on from the last code of the length
+    before. Only the code lengths matter then: with the next 64 input bits read as a number,
+    the code's length is that of the first step whose last code left justified is not below
+    it, and its byte is symbol[bits of that length + base]. The search starts from the
+    step start gives for the first 8 bits. A step per code length in use, so well under
+    a kilobyte in all.
+*/
+typedef struct canon_step {
+    uint64_t last;
+    uint64_t base;
+    int len;
+} canon_step;
+typedef struct canon {
+    int lengths;
+    unsigned char start[256];
+    unsigned char symbol[256];
+    canon_step step[];
+} canon;
+/*
+    The encoding and decoding tables built from a dictionary.
+    packed holds every byte's code in one word, the code's bits above its length in the
+    low 8 bits, for dictionaries whose codes fit the encoder's accumulator.
+    Codes of up to DECODE_BITS bits are decoded with one lookup of the next DECODE_BITS
+    input bits, longer ones with a second lookup in a table for their first DECODE_BITS
+    bits. A table entry holds the byte and the code length, or for a long prefix, the
+    offset and index width of its second level table. A canonical dictionary whose tables
+    would be large, or whose codes are too long for two levels, is decoded with canonical
+    instead, which takes more steps per code but stays in L1. Any other dictionary with
+    codes too long for two levels is decoded by walking a binary tree of the codes.
+*/
+typedef struct codebook {
+    m_node * dict;
+    int shortest;
+    int longest;
+    uint64_t packed[256];
+    canon * canonical;
+    uint32_t * table;
+    uint32_t table_size;
+    int32_t (* tree)[2];
+    int builtin;
+    uint64_t hash;
+    struct codebook * next;
+} codebook;
+static pthread_mutex_t codebooks_lock = PTHREAD_MUTEX_INITIALIZER;
+static codebook * codebooks = NULL;
+// Codebooks of dictionaries no longer in use, kept for reuse as threads may still look at them.
+static codebook * spare = NULL;
+// The last codebook each thread used, found without taking the lock.
+static __thread codebook * last_codebook = NULL;
+
+// The value of a code's bits, first bit highest.
+static uint64_t code_value(m_node * node) {
+    uint64_t v = 0;
+    for (int i = 0; i < node->code_l; i++) {
+        v = (v << 1) | node->code[i];
+    }
+    return v;
+}
+/*
+    Build the lookup tables. Longer codes are entered first, so where one code is a prefix
+    of another the shorter overwrites it, matching the first code found reading bit by bit.
+*/
+static void build_tables(codebook * d, m_node * dict) {
+    int widths[1 << DECODE_BITS] = {0};
+    for (int i = 0; i < 256; i++) {
+        int len = dict[i].code_l;
+        if (len > DECODE_BITS) {
+            uint32_t prefix = code_value(&dict[i]) >> (len - DECODE_BITS);
+            if (len - DECODE_BITS > widths[prefix]) {
+                widths[prefix] = len - DECODE_BITS;
+            }
+        }
+    }
+    uint32_t offsets[1 << DECODE_BITS];
+    uint32_t total = 1 << DECODE_BITS;
+    for (int p = 0; p < (1 << DECODE_BITS); p++) {
+        offsets[p] = total;
+        total += widths[p] > 0 ? 1 << widths[p] : 0;
+    }
+    d->table = calloc(total, sizeof(uint32_t));
+    d->table_size = total;
+    for (int len = DECODE_BITS + DECODE_SUB_BITS; len > 0; len--) {
+        for (int i = 0; i < 256; i++) {
+            if (dict[i].code_l != len) {
+                continue;
+            }
+            uint32_t value = code_value(&dict[i]);
+            uint32_t leaf = ((uint32_t) len << 8) | dict[i].byte;
+            uint32_t * slots = d->table;
+            int free_bits = DECODE_BITS - len;
+            if (len > DECODE_BITS) {
+                uint32_t prefix = value >> (len - DECODE_BITS);
+                d->table[prefix] = DECODE_LINK | (offsets[prefix] << 5) | widths[prefix];
+                slots = d->table + offsets[prefix];
+                value &= (1U << (len - DECODE_BITS)) - 1;
+                free_bits = widths[prefix] - (len - DECODE_BITS);
+            }
+            for (uint32_t j = 0; j < (1U << free_bits); j++) {
+                slots[(value << free_bits) | j] = leaf;
+            }
+        }
+    }
+}
+/*
+    Number the codes of a dictionary canonically, by length and then byte, into codes
+    (each a code's bits in the low len bits). Returns the number of bytes with a code.
+*/
+int canonical_codes(m_node * dict, uint64_t codes[256]) {
+    uint64_t code = 0;
+    int prev = 0;
+    int coded = 0;
+    for (int len = 1; len <= 64; len++) {
+        for (int i = 0; i < 256; i++) {
+            if (dict[i].code_l != len) {
+                continue;
+            }
+            code <<= len - prev;
+            prev = len;
+            codes[i] = code++;
+            coded++;
+        }
+    }
+    return coded;
+}
+/*
+    Build the canonical decoding state if the dictionary's codes are canonical and fit
+    the decoder's 64 bit buffer with bits to spare.
+*/
+static void build_canonical(codebook * d, m_node * dict) {
+    uint64_t codes[256];
+    int coded = canonical_codes(dict, codes);
+    if (coded == 0 || d->longest > ENCODE_LONGEST) {
+        return;
+    }
+    int lengths = 0;
+    int seen[ENCODE_LONGEST + 1] = {0};
+    for (int i = 0; i < 256; i++) {
+        if (dict[i].code_l > 0 && code_value(&dict[i]) != codes[i]) {
+            return;
+        }
+        if (dict[i].code_l > 0 && !seen[dict[i].code_l]) {
+            seen[dict[i].code_l] = 1;
+            lengths++;
+        }
+    }
+    canon * c = calloc(1, sizeof(canon) + lengths * sizeof(canon_step));
+    int k = 0;
+    int n = 0;
+    for (int len = 1; len <= d->longest; len++) {
+        int count = 0;
+        uint64_t first = 0;
+        for (int i = 0; i < 256; i++) {
+            if (dict[i].code_l == len) {
+                if (count == 0) {
+                    first = codes[i];
                 }
+                c->symbol[n + count++] = dict[i].byte;
             }
-            curr_bits++;
-            if (curr_bits == total_bits) {
-                
-                if (count != 0) {
-                    free(buffer);
+        }
+        if (count == 0) {
+            continue;
+        }
+        c->step[k].len = len;
+        c->step[k].last = ((first + count) << (64 - len)) - 1;
+        c->step[k].base = n - first;
+        n += count;
+        k++;
+    }
+    c->lengths = lengths;
+    // The first step whose codes can begin with each 8 bits.
+    for (int top = 0, k = 0; top < 256; top++) {
+        while (k < lengths - 1 && c->step[k].last < ((uint64_t) top << 56)) {
+            k++;
+        }
+        c->start[top] = k;
+    }
+    d->canonical = c;
+}
+/*
+    Build the tree for dictionaries with very long codes. Node 0 is the root, a positive
+    child is a node and a negative one the byte -child - 1; 0 means no code goes that way.
+*/
+static void build_tree(codebook * d, m_node * dict) {
+    int total = 1;
+    for (int i = 0; i < 256; i++) {
+        total += dict[i].code_l;
+    }
+    d->tree = calloc(total, sizeof(int32_t[2]));
+    int used = 1;
+    for (int i = 0; i < 256; i++) {
+        int node = 0;
+        for (int j = 0; j < dict[i].code_l; j++) {
+            int32_t * child = &d->tree[node][dict[i].code[j]];
+            if (*child < 0) {
+                // A shorter code is a prefix of this one and is always matched first.
+                break;
+            }
+            if (j == dict[i].code_l - 1) {
+                *child = -(int32_t) dict[i].byte - 1;
+            }
+            else {
+                if (*child == 0) {
+                    *child = used++;
                 }
-                free((*input)->buffer);
-                (*input)->buffer = new_representation;
-                (*input)->length = rep_size;
-                return;
+                node = *child;
             }
         }
     }
-
-    return;
+}
+/*
+    A fingerprint of a dictionary's codes.
+*/
+static uint64_t hash_codes(m_node * dict) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 256; i++) {
+        h = (h ^ dict[i].code_l) * 0x100000001b3ULL;
+        for (int j = 0; j < dict[i].code_l; j++) {
+            h = (h ^ dict[i].code[j]) * 0x100000001b3ULL;
+        }
+    }
+    return h;
+}
+/*
+    The codebook for a dictionary, built on first use and kept until the dictionary is
+    replaced. A codebook is published by setting its dict last, so a thread finding its
+    dictionary there sees the tables complete.
+*/
+static codebook * codebook_for(m_node ** dict) {
+    codebook * d = last_codebook;
+    if (d != NULL && __atomic_load_n(&d->dict, __ATOMIC_ACQUIRE) == *dict) {
+        return d;
+    }
+    pthread_mutex_lock(&codebooks_lock);
+    d = codebooks;
+    while (d != NULL && d->dict != *dict) {
+        d = d->next;
+    }
+    if (d == NULL) {
+        d = spare;
+        if (d != NULL) {
+            spare = d->next;
+        }
+        else {
+            d = calloc(1, sizeof(codebook));
+        }
+        d->shortest = 255;
+        d->longest = 0;
+        d->canonical = NULL;
+        d->table = NULL;
+        d->table_size = 0;
+        d->tree = NULL;
+        d->builtin = 0;
+        d->hash = hash_codes(*dict);
+        for (int i = 0; i < 256; i++) {
+            int len = (*dict)[i].code_l;
+            if (len > 0 && len < d->shortest) {
+                d->shortest = len;
+            }
+            if (len > d->longest) {
+                d->longest = len;
+            }
+        }
+#ifdef CODEC
+        if (*dict == builtin_map) {
+            // Tables made ahead of time from this dictionary by create_codec.
+            memcpy(d->packed, codec_packed, sizeof(d->packed));
+            d->table = (uint32_t *) codec_table;
+            d->table_size = codec_table_size;
+            d->builtin = 1;
+        }
+#endif
+        build_canonical(d, *dict);
+        if (d->table == NULL) {
+            if (d->longest <= ENCODE_LONGEST) {
+                for (int i = 0; i < 256; i++) {
+                    d->packed[i] = ((uint64_t) code_value(&(*dict)[i]) << 8) | (*dict)[i].code_l;
+                }
+            }
+            if (d->longest <= DECODE_BITS + DECODE_SUB_BITS) {
+                build_tables(d, *dict);
+            }
+            if (d->canonical != NULL && (d->table == NULL || d->table_size > DECODE_TABLE_MOST)) {
+                // The canonical state decodes in a few hundred bytes instead of large tables.
+                free(d->table);
+                d->table = NULL;
+            }
+            else if (d->table == NULL) {
+                build_tree(d, *dict);
+            }
+        }
+        d->next = codebooks;
+        codebooks = d;
+        __atomic_store_n(&d->dict, *dict, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&codebooks_lock);
+    last_codebook = d;
+    return d;
+}
+/*
+    Free the tables of a dictionary that has been replaced. The caller makes sure no
+    thread is still coding with it. The codebook itself is kept, no longer matching any
+    dictionary, since threads may still hold it as the last one they used.
+*/
+void codebook_forget(m_node * map) {
+    pthread_mutex_lock(&codebooks_lock);
+    codebook ** p = &codebooks;
+    while (*p != NULL && (*p)->dict != map) {
+        p = &(*p)->next;
+    }
+    codebook * d = *p;
+#ifdef CODEC
+    if (map == builtin_map) {
+        // A map allocated later at the same address is not the compiled in one.
+        builtin_map = NULL;
+    }
+#endif
+    if (d != NULL) {
+        *p = d->next;
+        __atomic_store_n(&d->dict, NULL, __ATOMIC_RELEASE);
+        if (!d->builtin) {
+            free(d->table);
+        }
+        free(d->tree);
+        free(d->canonical);
+        d->next = spare;
+        spare = d;
+    }
+    pthread_mutex_unlock(&codebooks_lock);
+}
+/*
+    The number of code bits in a compressed payload: its bits less the padding
+    given by the last byte.
+*/
+static uint64_t payload_bits(const message * input) {
+    if (input->length == 0) {
+        return 0;
+    }
+    uint64_t bits = (input->length - 1) * 8;
+    unsigned char padding = input->buffer[input->length - 1];
+    return padding <= bits ? bits - padding : 0;
+}
+/*
+    The decoding table of a dictionary and its number of entries, or NULL for a dictionary
+    decoded canonically or with a tree. Used by create_codec to write the table out as C source.
+*/
+const uint32_t * decode_table(m_node ** dict, uint32_t * size, int * bits, int * sub_bits) {
+    codebook * d = codebook_for(dict);
+    *size = d->table_size;
+    *bits = DECODE_BITS;
+    *sub_bits = DECODE_SUB_BITS;
+    return d->table;
+}
+/*
+    Decode the codes starting from bit p up to bit end, of a payload with total code bits.
+    Input bits are read through a 64 bit buffer. The bit positions of the first
+    DECODE_SYNC codes are recorded in marks, if given. Returns the bit after the last
+    code, and sets broken if a code did not match or ran past the total.
+*/
+static uint64_t decode_run(codebook * d, const unsigned char * in, uint64_t in_len, uint64_t total,
+    uint64_t p, uint64_t end, unsigned char * out, uint64_t * n, uint64_t * marks, int * marked, int * broken) {
+    uint64_t pos = p >> 3;
+    uint64_t acc = 0;
+    int have = 0;
+    const canon * c = d->table == NULL ? d->canonical : NULL;
+    // Bits a lookup looks at.
+    int need = c != NULL ? d->longest : DECODE_BITS + DECODE_SUB_BITS;
+    if ((p & 7) != 0 && pos < in_len) {
+        // Start with the bits of p's first byte from p on, so every top up below fills
+        // the buffer to at least 56 bits, as a lookup of the longest code may need.
+        acc = (uint64_t) in[pos++] << (56 + (p & 7));
+        have = 8 - (p & 7);
+    }
+    while (p < end) {
+        if (have < need) {
+            if (pos + 8 <= in_len) {
+                // Top up to at least 56 bits with one unaligned load.
+                uint64_t next;
+                memcpy(&next, in + pos, 8);
+                acc |= bswap_64(next) >> have;
+                pos += (63 - have) >> 3;
+                have |= 56;
+            }
+            else {
+                while (have <= 56 && pos < in_len) {
+                    acc |= (uint64_t) in[pos++] << (56 - have);
+                    have += 8;
+                }
+            }
+        }
+        uint32_t entry;
+        if (c != NULL) {
+            int k = c->start[acc >> 56];
+            while (k < c->lengths && acc > c->step[k].last) {
+                k++;
+            }
+            if (k == c->lengths) {
+                entry = 0;
+            }
+            else {
+                int len = c->step[k].len;
+                entry = (len << 8) | c->symbol[(acc >> (64 - len)) + c->step[k].base];
+            }
+        }
+        else {
+            entry = d->table[acc >> (64 - DECODE_BITS)];
+            if (entry & DECODE_LINK) {
+                int width = entry & 31;
+                entry = d->table[((entry & ~DECODE_LINK) >> 5) + ((acc << DECODE_BITS) >> (64 - width))];
+            }
+        }
+        uint32_t len = (entry >> 8) & 0xff;
+        if (len == 0 || len > total - p) {
+            // No code matches, or only part of one is left.
+            *broken = 1;
+            break;
+        }
+        if (marks != NULL && *marked < DECODE_SYNC) {
+            marks[(*marked)++] = p;
+        }
+        out[(*n)++] = entry & 0xff;
+        acc <<= len;
+        have -= len;
+        p += len;
+    }
+    return p;
+}
+/*
+    Decode a compressed payload: the encoded bits, then a byte giving the number of padding
+    bits at the end of the last one. The output is allocated up front for the most bytes
+    the bits could hold.
+*/
+void decompress(message ** input, m_node ** dict) {
+    codebook * d = codebook_for(dict);
+    const unsigned char * in = (*input)->buffer;
+    uint64_t in_len = (*input)->length > 0 ? (*input)->length - 1 : 0;
+    uint64_t left = payload_bits(*input);
+    unsigned char * out = malloc(left / d->shortest + 1);
+    uint64_t n = 0;
+    if (d->table != NULL || d->canonical != NULL) {
+        int broken = 0;
+        decode_run(d, in, in_len, left, 0, left, out, &n, NULL, NULL, &broken);
+    }
+    else {
+        int node = 0;
+        for (uint64_t bit = 0; bit < left; bit++) {
+            int32_t child = d->tree[node][(in[bit / 8] >> (7 - bit % 8)) & 1];
+            if (child == 0) {
+                break;
+            }
+            if (child < 0) {
+                out[n++] = -child - 1;
+                node = 0;
+            }
+            else {
+                node = child;
+            }
+        }
+    }
+    free((*input)->buffer);
+    (*input)->buffer = out;
+    (*input)->length = n;
+}
+/*
+    Cut a compressed payload into count parts of about equal bits, to be decoded at once
+    with decompress_part and put together with decompress_join. Returns 0 if the
+    dictionary is decoded with a tree, and the payload must be decoded with decompress instead.
+*/
+int decompress_split(message * input, m_node ** dict, decode_part * parts, int count) {
+    codebook * d = codebook_for(dict);
+    if (d->table == NULL && d->canonical == NULL) {
+        return 0;
+    }
+    uint64_t total = payload_bits(input);
+    for (int i = 0; i < count; i++) {
+        parts[i].start = total / count * i;
+        parts[i].end = i == count - 1 ? total : total / count * (i + 1);
+        // Every code starting in the part, the last perhaps running past its end.
+        parts[i].out = malloc((parts[i].end - parts[i].start) / d->shortest + 1);
+        parts[i].n = 0;
+        parts[i].marked = 0;
+        parts[i].broken = 0;
+    }
+    return 1;
+}
+/*
+    Decode a part as though a code starts at its first bit. Only the first part is sure
+    to, but the codes of a prefix code usually fall back into step some hundreds of bits
+    after a wrong start, so most of what is decoded here is kept by decompress_join.
+*/
+void decompress_part(message * input, m_node ** dict, decode_part * part) {
+    codebook * d = codebook_for(dict);
+    uint64_t in_len = input->length - 1;
+    part->stop = decode_run(d, input->buffer, in_len, payload_bits(input), part->start, part->end,
+        part->out, &part->n, part->marks, &part->marked, &part->broken);
+}
+/*
+    Put the decoded parts together, in order. The bit after the last code of one part is
+    where the codes of the next really start. Where that is not the part's first bit, the
+    codes from there are decoded again until one starts at a bit the part had a code start
+    at, from which on the part's codes are the true ones. A part that never falls into step
+    within its recorded codes is decoded again in full. The output is the same as decompress.
+*/
+void decompress_join(message ** input, m_node ** dict, decode_part * parts, int count) {
+    codebook * d = codebook_for(dict);
+    const unsigned char * in = (*input)->buffer;
+    uint64_t in_len = (*input)->length - 1;
+    uint64_t total = payload_bits(*input);
+    unsigned char * out = malloc(total / d->shortest + 1);
+    uint64_t n = 0;
+    uint64_t p = 0;
+    int broken = 0;
+    for (int i = 0; i < count && !broken; i++) {
+        decode_part * part = &parts[i];
+        int k = 0;
+        while (p < part->end && p != part->start) {
+            while (k < part->marked && part->marks[k] < p) {
+                k++;
+            }
+            if (k == part->marked) {
+                // Out of step for every recorded code, decode the rest of the part.
+                p = decode_run(d, in, in_len, total, p, part->end, out, &n, NULL, NULL, &broken);
+                break;
+            }
+            if (part->marks[k] == p) {
+                break;
+            }
+            p = decode_run(d, in, in_len, total, p, p + 1, out, &n, NULL, NULL, &broken);
+            if (broken) {
+                break;
+            }
+        }
+        if (!broken && p < part->end) {
+            // In step from the part's k'th code.
+            memcpy(out + n, part->out + k, part->n - k);
+            n += part->n - k;
+            p = part->stop;
+            broken = part->broken;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        free(parts[i].out);
+    }
+    free((*input)->buffer);
+    (*input)->buffer = out;
+    (*input)->length = n;
 }
 
-void compress(message** input, m_node ** dict) {
-    unsigned char * new_representation = NULL;
-    int curr_byte = 0;
-    int curr_bit = 8;
-    int total_count = 0;
-    /* 
-        Iterate through the bytes of the message payload.
-        Write to the new_representation, extending
-        the representation each time we have read in 8 bits from the dictionary.
-    */
-    for (int i = 0; i < (*input)->length; i++) {
-        for (int j = 0; j < (*dict)[(unsigned int)(*input)->buffer[i]].code_l; j++) {
-            if (curr_bit == 8) {
-                curr_byte++;
-                new_representation = realloc(new_representation, curr_byte);
+/*
+    Start an empty Huffman encoding.
+*/
+void encode_start(encoder * e) {
+    e->buffer = NULL;
+    e->length = 0;
+    e->capacity = 0;
+    e->bit = 8;
+    e->bits = 0;
+}
+/*
+    Make room for at least size bytes of output, growing the buffer geometrically.
+*/
+static void encode_reserve(encoder * e, uint64_t size) {
+    if (size > e->capacity) {
+        e->capacity = size > 2 * e->capacity ? size : 2 * e->capacity;
+        e->buffer = realloc(e->buffer, e->capacity);
+    }
+}
+/*
+    Append codes a bit at a time, for dictionaries with codes too long for the accumulator.
+*/
+static void encode_bits(encoder * e, const unsigned char * input, uint64_t length, m_node ** dict) {
+    for (uint64_t i = 0; i < length; i++) {
+        m_node * node = &(*dict)[(unsigned int) input[i]];
+        for (int j = 0; j < node->code_l; j++) {
+            if (e->bit == 8) {
+                e->length++;
+                encode_reserve(e, e->length);
             }
-            if ((*dict)[(unsigned int) (*input)->buffer[i]].code[j]) {
-                new_representation[curr_byte -1] |= (1 << (curr_bit - 1));
+            if (node->code[j]) {
+                e->buffer[e->length - 1] |= (1 << (e->bit - 1));
             }
             else {
-                new_representation[curr_byte -1] &= ~(1 << (curr_bit - 1));
+                e->buffer[e->length - 1] &= ~(1 << (e->bit - 1));
             }
-            curr_bit--;
-            total_count++;
-            if (curr_bit == 0) {
-                curr_bit = 8;
+            e->bit--;
+            e->bits++;
+            if (e->bit == 0) {
+                e->bit = 8;
             }
         }
     }
+}
+/*
+    Where packed codes are written: bits are kept from the top of the accumulator down,
+    and written out eight bytes at a time once the next code would not fit.
+*/
+typedef struct bitsink {
+    unsigned char * out;
+    uint64_t acc;
+    int n;
+} bitsink;
+
+static inline void sink_push(bitsink * k, uint64_t code, int len) {
+    if (k->n + len > 64) {
+        // Write out the whole bytes, keeping the rest.
+        uint64_t word = bswap_64(k->acc);
+        memcpy(k->out, &word, 8);
+        k->out += k->n >> 3;
+        k->acc = k->n >= 64 ? 0 : k->acc << (k->n & ~7);
+        k->n &= 7;
+    }
+    if (len > 0) {
+        k->acc |= code << (64 - k->n - len);
+        k->n += len;
+    }
+}
+/*
+    Push the codes of length bytes, one at a time.
+*/
+static void kernel_scalar(bitsink * sink, const unsigned char * input, uint64_t length, const uint64_t * packed) {
+    bitsink k = *sink;
+    for (uint64_t i = 0; i < length; i++) {
+        uint64_t code = packed[input[i]];
+        sink_push(&k, code >> 8, code & 0xff);
+    }
+    *sink = k;
+}
+#if defined(__x86_64__)
+/*
+    Push the codes of four bytes at once where they fit in ENCODE_LONGEST bits: the
+    lengths' suffix sums give each code's distance from the end of the group, and the
+    codes shifted by those are combined into one push. SSE4.2 computes the sums, the
+    lookups and shifts stay scalar.
+*/
+__attribute__((target("sse4.2")))
+static void kernel_sse42(bitsink * sink, const unsigned char * input, uint64_t length, const uint64_t * packed) {
+    bitsink k = *sink;
+    uint64_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        uint64_t w0 = packed[input[i]];
+        uint64_t w1 = packed[input[i + 1]];
+        uint64_t w2 = packed[input[i + 2]];
+        uint64_t w3 = packed[input[i + 3]];
+        __m128i lens = _mm_set_epi32(w3 & 0xff, w2 & 0xff, w1 & 0xff, w0 & 0xff);
+        // Inclusive suffix sums, then less each code's own length.
+        __m128i sums = _mm_add_epi32(lens, _mm_srli_si128(lens, 4));
+        sums = _mm_add_epi32(sums, _mm_srli_si128(sums, 8));
+        __m128i after = _mm_sub_epi32(sums, lens);
+        int total = _mm_cvtsi128_si32(sums);
+        if (total > ENCODE_LONGEST) {
+            sink_push(&k, w0 >> 8, w0 & 0xff);
+            sink_push(&k, w1 >> 8, w1 & 0xff);
+            sink_push(&k, w2 >> 8, w2 & 0xff);
+            sink_push(&k, w3 >> 8, w3 & 0xff);
+            continue;
+        }
+        uint64_t group = ((w0 >> 8) << _mm_cvtsi128_si32(after)) | ((w1 >> 8) << _mm_extract_epi32(after, 1)) |
+            ((w2 >> 8) << _mm_extract_epi32(after, 2)) | ((w3 >> 8) << _mm_extract_epi32(after, 3));
+        sink_push(&k, group, total);
+    }
+    *sink = k;
+    kernel_scalar(sink, input + i, length - i, packed);
+}
+#endif
+/*
+    The SSE4.2 kernel where this CPU runs it, chosen once from cpuid.
+*/
+static void (* encode_kernel)(bitsink *, const unsigned char *, uint64_t, const uint64_t *) = kernel_scalar;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void pick_kernel(void) {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        encode_kernel = kernel_sse42;
+    }
+#endif
+}
+/*
+    Append the codes for length bytes of input to an encoding, so a payload
+    can be encoded from several pieces without joining them first.
+    Codes are taken from the packed table and pushed into a 64 bit accumulator,
+    which is written out eight bytes at a time into a buffer sized up front for
+    the longest code. All kernels write the same bits.
+*/
+void encode(encoder * e, const unsigned char * input, uint64_t length, m_node ** dict) {
+    codebook * cb = codebook_for(dict);
+    if (cb->longest > ENCODE_LONGEST) {
+        encode_bits(e, input, length, dict);
+        return;
+    }
+    pthread_once(&kernel_once, pick_kernel);
+    // Room for every byte at the longest code, and for a whole word stored past the end.
+    encode_reserve(e, e->length + (length * cb->longest + 7) / 8 + 8);
+    // Start from the bits of a partly filled last byte.
+    bitsink k = {NULL, 0, 0};
+    if (e->bit != 8) {
+        k.n = 8 - e->bit;
+        e->length--;
+        k.acc = (uint64_t) (e->buffer[e->length] & (0xff << e->bit)) << 56;
+    }
+    uint64_t start = e->length * 8 + k.n;
+    k.out = e->buffer + e->length;
+    encode_kernel(&k, input, length, cb->packed);
+    uint64_t word = bswap_64(k.acc);
+    memcpy(k.out, &word, 8);
+    k.out += (k.n + 7) >> 3;
+    e->length = k.out - e->buffer;
+    e->bit = (k.n & 7) == 0 ? 8 : 8 - (k.n & 7);
+    e->bits += e->length * 8 - (8 - (k.n & 7)) % 8 - start;
+}
+/*
+    Append nbits of an encoding made earlier, starting first bits into it, without going
+    back through the dictionary. The bits are shifted into place a byte at a time whatever
+    the bit positions of the source and the encoding.
+*/
+void encode_append(encoder * e, const unsigned char * bits, uint64_t first, uint64_t nbits) {
+    if (nbits == 0) {
+        return;
+    }
+    bits += first / 8;
+    int skew = first % 8;
+    // Free bits at the bottom of the last byte.
+    int free_bits = e->bit == 8 ? 0 : e->bit;
+    uint64_t whole = nbits / 8;
+    int rest = nbits % 8;
+    encode_reserve(e, e->length + whole + 1);
+    uint64_t i = 0;
+    if (skew == 0 && free_bits == 0) {
+        // Byte aligned on both sides.
+        memcpy(e->buffer + e->length, bits, whole);
+        e->length += whole;
+        i = whole;
+    }
+    else if (skew == 0) {
+        // Eight bytes at a time, each shifted down by the bits used of the last byte.
+        int used = 8 - free_bits;
+        uint64_t acc = (uint64_t) (e->buffer[e->length - 1] & (0xff << free_bits)) << 56;
+        unsigned char * out = e->buffer + e->length - 1;
+        for (; i + 8 <= whole; i += 8) {
+            uint64_t word;
+            memcpy(&word, bits + i, 8);
+            word = bswap_64(word);
+            uint64_t joined = bswap_64(acc | (word >> used));
+            memcpy(out, &joined, 8);
+            out += 8;
+            acc = word << (64 - used);
+        }
+        *out = acc >> 56;
+        e->length = out + 1 - e->buffer;
+    }
+    for (; i <= whole; i++) {
+        int count = i < whole ? 8 : rest;
+        if (count == 0) {
+            break;
+        }
+        unsigned char byte = bits[i] << skew;
+        if (skew + count > 8) {
+            byte |= bits[i + 1] >> (8 - skew);
+        }
+        byte &= 0xff << (8 - count);
+        if (free_bits > 0) {
+            e->buffer[e->length - 1] = (e->buffer[e->length - 1] & (0xff << free_bits)) | (byte >> (8 - free_bits));
+        }
+        if (count > free_bits) {
+            // What did not fit starts a new byte.
+            e->buffer[e->length++] = byte << free_bits;
+            free_bits = 8 - (count - free_bits);
+        }
+        else {
+            free_bits -= count;
+        }
+    }
+    e->bit = free_bits == 0 ? 8 : free_bits;
+    e->bits += nbits;
+}
+/*
+    A fingerprint of a dictionary's codes, so encodings stored on disk or cached are
+    only used with the dictionary that made them.
+*/
+uint64_t dict_hash(m_node ** dict) {
+    return codebook_for(dict)->hash;
+}
+/*
+    Pad the final byte and append the padding count, completing the encoding.
+*/
+void encode_finish(encoder * e) {
     // Zero out any bits remaining for padding.
-    while (curr_bit >0 && curr_bit != 8) {
-        new_representation[curr_byte -1] &= ~(1 << (curr_bit - 1));
-        curr_bit--;
+    while (e->bit > 0 && e->bit != 8) {
+        e->buffer[e->length - 1] &= ~(1 << (e->bit - 1));
+        e->bit--;
     }
     // Add the number of padding bits to the end.
-    curr_byte++;
-    new_representation = realloc(new_representation, curr_byte);
-    u_int8_t bits_left = (8 - (total_count % 8)) % 8;
-    new_representation[curr_byte - 1] = bits_left;
-    (*input)->length = curr_byte;
+    e->length++;
+    encode_reserve(e, e->length);
+    e->buffer[e->length - 1] = (8 - (e->bits % 8)) % 8;
+}
+
+void compress(message** input, m_node ** dict) {
+    encoder e;
+    encode_start(&e);
+    encode(&e, (*input)->buffer, (*input)->length, dict);
+    encode_finish(&e);
+    (*input)->length = e.length;
     free((*input)->buffer);
-    (*input)->buffer = new_representation;
+    (*input)->buffer = e.buffer;
 }
\ No newline at end of file
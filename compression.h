@@ -1,5 +1,51 @@
-#include "message_handling.h"
-
-void decompress(message ** input, m_node ** dict);
-void compress(message** input, m_node ** dict);
-void create_map(m_node ** compressor);
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+#include "message_handling.h"
+
+/*
+    A Huffman encoding in progress: the bytes written so far and the room allocated
+    for them, the next free bit in the last byte (8 for a fresh byte) and the number
+    of code bits written.
+*/
+typedef struct encoder {
+    unsigned char * buffer;
+    uint64_t length;
+    uint64_t capacity;
+    int bit;
+    uint64_t bits;
+} encoder;
+// Code positions kept per part of a payload decoded in parts, to fall back into step at.
+#define DECODE_SYNC 1024
+/*
+    A part of a compressed payload decoded on its own, from bit start up to bit end:
+    the bytes decoded, the bit after the last code, whether a code failed to match,
+    and the bits the first DECODE_SYNC codes started at.
+*/
+typedef struct decode_part {
+    uint64_t start;
+    uint64_t end;
+    unsigned char * out;
+    uint64_t n;
+    uint64_t stop;
+    int broken;
+    uint64_t marks[DECODE_SYNC];
+    int marked;
+} decode_part;
+void decompress(message ** input, m_node ** dict);
+int decompress_split(message * input, m_node ** dict, decode_part * parts, int count);
+void decompress_part(message * input, m_node ** dict, decode_part * part);
+void decompress_join(message ** input, m_node ** dict, decode_part * parts, int count);
+void compress(message** input, m_node ** dict);
+void encode_start(encoder * e);
+void encode(encoder * e, const unsigned char * input, uint64_t length, m_node ** dict);
+void encode_append(encoder * e, const unsigned char * bits, uint64_t first, uint64_t nbits);
+uint64_t dict_hash(m_node ** dict);
+void encode_finish(encoder * e);
+void create_map(m_node ** compressor);
+void load_map(m_node ** compressor, const char * path);
+int read_map(m_node ** compressor, const char * path);
+void free_map(m_node * map);
+void codebook_forget(m_node * map);
+int canonical_codes(m_node * dict, uint64_t codes[256]);
+const uint32_t * decode_table(m_node ** dict, uint32_t * size, int * bits, int * sub_bits);
+#endif
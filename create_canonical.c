@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compression.h"
+
+/*
+    Append the low count bits of value to out, first bit highest.
+*/
+static void put_bits(unsigned char * out, uint64_t * at, uint64_t value, int count) {
+    for (int i = count - 1; i >= 0; i--) {
+        if ((value >> i) & 1) {
+            out[*at / 8] |= 0x80 >> (*at % 8);
+        }
+        (*at)++;
+    }
+}
+/*
+    Rewrite a dictionary in canonical form: every byte keeps the length of its code,
+    and the codes are renumbered by length and then byte. The server decodes such a
+    dictionary from the code lengths alone. The codes change, so clients need the
+    new dictionary too.
+*/
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        printf("Usage: %s <dictionary> <output>\n", argv[0]);
+        printf("Example: %s \"(sample)compression.dict\" canonical.dict\n", argv[0]);
+        return 1;
+    }
+    m_node * dict;
+    load_map(&dict, argv[1]);
+    uint64_t codes[256];
+    canonical_codes(dict, codes);
+    uint64_t bits = 0;
+    int changed = 0;
+    for (int i = 0; i < 256; i++) {
+        if (dict[i].code_l > 64) {
+            fprintf(stderr, "%s: a code is longer than 64 bits\n", argv[1]);
+            return 1;
+        }
+        for (int j = 0; j < dict[i].code_l; j++) {
+            changed |= dict[i].code[j] != ((codes[i] >> (dict[i].code_l - 1 - j)) & 1);
+        }
+        bits += 8 + dict[i].code_l;
+    }
+    unsigned char * out = calloc((bits + 7) / 8, 1);
+    uint64_t at = 0;
+    for (int i = 0; i < 256; i++) {
+        put_bits(out, &at, dict[i].code_l, 8);
+        put_bits(out, &at, codes[i], dict[i].code_l);
+    }
+    FILE * fp = fopen(argv[2], "wb");
+    if (fp == NULL || fwrite(out, (bits + 7) / 8, 1, fp) != 1 || fclose(fp) != 0) {
+        perror(argv[2]);
+        return 1;
+    }
+    printf("Wrote %s: %s\n", argv[2], changed ? "codes renumbered" : "already canonical");
+    free(out);
+    return 0;
+}
\ No newline at end of file
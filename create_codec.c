@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "compression.h"
+
+/*
+    Write the codec tables of a dictionary as C source, for a server built with them
+    compiled in (make server_codec).
+*/
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        printf("Usage: %s <dictionary> <output.c>\n", argv[0]);
+        printf("Example: %s \"(sample)compression.dict\" codec.c\n", argv[0]);
+        return 1;
+    }
+    FILE * in = fopen(argv[1], "rb");
+    struct stat st;
+    if (in == NULL || fstat(fileno(in), &st) == -1) {
+        perror(argv[1]);
+        return 1;
+    }
+    unsigned char * source = malloc(st.st_size + 1);
+    if (fread(source, 1, st.st_size, in) != (size_t) st.st_size) {
+        perror(argv[1]);
+        return 1;
+    }
+    fclose(in);
+    m_node * dict;
+    load_map(&dict, argv[1]);
+    uint32_t size;
+    int bits;
+    int sub_bits;
+    const uint32_t * table = decode_table(&dict, &size, &bits, &sub_bits);
+    uint64_t packed[256];
+    for (int i = 0; i < 256; i++) {
+        if (dict[i].code_l > 56 || table == NULL) {
+            fprintf(stderr, "%s: decoded without tables, there are none to build in\n", argv[1]);
+            return 1;
+        }
+        uint64_t v = 0;
+        for (int j = 0; j < dict[i].code_l; j++) {
+            v = (v << 1) | dict[i].code[j];
+        }
+        packed[i] = (v << 8) | dict[i].code_l;
+    }
+    FILE * out = fopen(argv[2], "w");
+    if (out == NULL) {
+        perror(argv[2]);
+        return 1;
+    }
+    fprintf(out, "// Made by create_codec from %s, do not edit.\n#include \"codec.h\"\n\n", argv[1]);
+    fprintf(out, "const int codec_source_length = %ld;\n", (long) st.st_size);
+    fprintf(out, "const unsigned char codec_source[] = {");
+    for (long i = 0; i < st.st_size; i++) {
+        fprintf(out, "%s0x%02x,", i % 16 == 0 ? "\n    " : " ", source[i]);
+    }
+    fprintf(out, "\n};\nconst int codec_decode_bits = %d;\nconst int codec_decode_sub_bits = %d;\n", bits, sub_bits);
+    fprintf(out, "const uint64_t codec_packed[256] = {");
+    for (int i = 0; i < 256; i++) {
+        fprintf(out, "%s0x%llxULL,", i % 4 == 0 ? "\n    " : " ", (unsigned long long) packed[i]);
+    }
+    fprintf(out, "\n};\nconst uint32_t codec_table_size = %u;\n", size);
+    fprintf(out, "const uint32_t codec_table[] = {");
+    for (uint32_t i = 0; i < size; i++) {
+        fprintf(out, "%s0x%08x,", i % 8 == 0 ? "\n    " : " ", table[i]);
+    }
+    fprintf(out, "\n};\n");
+    if (fclose(out) != 0) {
+        perror(argv[2]);
+        return 1;
+    }
+    printf("Wrote %s: %u decoding table entries\n", argv[2], size);
+    return 0;
+}
\ No newline at end of file
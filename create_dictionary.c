@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "compression.h"
+
+// Bytes of a file counted as one piece of work.
+#define TRAIN_CHUNK (4 << 20)
+// Longest code allowed by default, which keeps every code within the server's decoding tables.
+#define TRAIN_LONGEST 16
+
+typedef struct sample {
+    char * path;
+    uint64_t size;
+} sample;
+/*
+    The corpus, cut into chunks that the counting threads take in turn.
+*/
+typedef struct corpus {
+    sample * files;
+    int nfiles;
+    uint64_t * starts;
+    uint64_t chunks;
+    uint64_t next;
+    uint64_t counts[256];
+    pthread_mutex_t lock;
+} corpus;
+/*
+    An entry of a package-merge list: a byte's leaf, or a package of two entries
+    from the list one level down.
+*/
+typedef struct item {
+    uint64_t weight;
+    int byte;
+    int left;
+    int right;
+} item;
+
+static void add_file(corpus * c, const char * path, uint64_t size) {
+    c->files = realloc(c->files, (c->nfiles + 1) * sizeof(sample));
+    c->files[c->nfiles].path = strdup(path);
+    c->files[c->nfiles].size = size;
+    c->nfiles++;
+}
+/*
+    Add a file to the corpus, or every regular file of a directory, skipping hidden
+    entries such as the sidecars.
+*/
+static int add_path(corpus * c, const char * path) {
+    struct stat st;
+    if (stat(path, &st) == -1) {
+        perror(path);
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        add_file(c, path, st.st_size);
+        return 0;
+    }
+    DIR * d = opendir(path);
+    if (d == NULL) {
+        perror(path);
+        return -1;
+    }
+    struct dirent * de;
+    char name[4096];
+    while ((de = readdir(d)) != NULL) {
+        snprintf(name, sizeof(name), "%s/%s", path, de->d_name);
+        if (de->d_name[0] != '.' && stat(name, &st) == 0 && S_ISREG(st.st_mode)) {
+            add_file(c, name, st.st_size);
+        }
+    }
+    closedir(d);
+    return 0;
+}
+/*
+    Count the bytes of the chunks taken from the corpus. Four tables take turns, so
+    runs of the same byte do not wait on the increment before.
+*/
+static void * count_chunks(void * args) {
+    corpus * c = args;
+    uint64_t counts[4][256];
+    memset(counts, 0, sizeof(counts));
+    unsigned char * buf = malloc(TRAIN_CHUNK);
+    int fd = -1;
+    int open_file = -1;
+    uint64_t chunk;
+    while ((chunk = __atomic_fetch_add(&c->next, 1, __ATOMIC_RELAXED)) < c->chunks) {
+        // The last file starting at or before the chunk, passing over empty files.
+        int lo = 0;
+        int hi = c->nfiles;
+        while (hi - lo > 1) {
+            int mid = (lo + hi) / 2;
+            if (c->starts[mid] <= chunk) {
+                lo = mid;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        int f = lo;
+        if (f != open_file) {
+            if (fd != -1) {
+                close(fd);
+            }
+            fd = open(c->files[f].path, O_RDONLY);
+            open_file = f;
+            if (fd == -1) {
+                perror(c->files[f].path);
+            }
+        }
+        uint64_t offset = (chunk - c->starts[f]) * TRAIN_CHUNK;
+        ssize_t n = fd == -1 ? 0 : pread(fd, buf, TRAIN_CHUNK, offset);
+        ssize_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            counts[0][buf[i]]++;
+            counts[1][buf[i + 1]]++;
+            counts[2][buf[i + 2]]++;
+            counts[3][buf[i + 3]]++;
+        }
+        for (; i < n; i++) {
+            counts[0][buf[i]]++;
+        }
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    free(buf);
+    pthread_mutex_lock(&c->lock);
+    for (int i = 0; i < 256; i++) {
+        c->counts[i] += counts[0][i] + counts[1][i] + counts[2][i] + counts[3][i];
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+/*
+    Count every byte of the corpus on one thread per core.
+*/
+static void count_corpus(corpus * c) {
+    c->starts = malloc((c->nfiles + 1) * sizeof(uint64_t));
+    c->chunks = 0;
+    for (int i = 0; i < c->nfiles; i++) {
+        c->starts[i] = c->chunks;
+        c->chunks += (c->files[i].size + TRAIN_CHUNK - 1) / TRAIN_CHUNK;
+    }
+    c->starts[c->nfiles] = c->chunks;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int nthreads = cores < 1 ? 1 : cores > 64 ? 64 : cores;
+    if ((uint64_t) nthreads > c->chunks) {
+        nthreads = c->chunks > 0 ? c->chunks : 1;
+    }
+    pthread_t threads[64];
+    for (int i = 1; i < nthreads; i++) {
+        pthread_create(&threads[i], NULL, count_chunks, c);
+    }
+    count_chunks(c);
+    for (int i = 1; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    printf("Counted %d files in %lu chunks on %d threads\n", c->nfiles, (unsigned long) c->chunks, nthreads);
+}
+
+/*
+    Add one to the length of every byte whose leaf is in the entry at.
+*/
+static void count_leaves(item * pool, int at, uint8_t lengths[256]) {
+    if (pool[at].byte >= 0) {
+        lengths[pool[at].byte]++;
+        return;
+    }
+    count_leaves(pool, pool[at].left, lengths);
+    count_leaves(pool, pool[at].right, lengths);
+}
+/*
+    The optimal code lengths of at most longest bits for the byte counts, by package-merge.
+    Every byte gets a code, those never seen included, so any payload can still be encoded.
+    Leaves are taken in order of count, and packages of the list below are merged in;
+    the first 510 entries of the final list give each byte's length as its leaf's count.
+*/
+static void limited_lengths(const uint64_t counts[256], int longest, uint8_t lengths[256]) {
+    item * pool = malloc((256 + 256 * longest) * sizeof(item));
+    int nleaves = 0;
+    for (int i = 0; i < 256; i++) {
+        pool[nleaves++] = (item) {counts[i], i, -1, -1};
+    }
+    // Insertion sort by count and then byte, which keeps ties in byte order.
+    for (int i = 1; i < 256; i++) {
+        item leaf = pool[i];
+        int j = i;
+        while (j > 0 && pool[j - 1].weight > leaf.weight) {
+            pool[j] = pool[j - 1];
+            j--;
+        }
+        pool[j] = leaf;
+    }
+    int used = 256;
+    int * list = malloc(512 * sizeof(int));
+    int * merged = malloc(512 * sizeof(int));
+    int len = 256;
+    for (int i = 0; i < 256; i++) {
+        list[i] = i;
+    }
+    for (int level = 1; level < longest; level++) {
+        int packages = len / 2;
+        int first = used;
+        for (int i = 0; i < packages; i++) {
+            pool[used++] = (item) {pool[list[2 * i]].weight + pool[list[2 * i + 1]].weight,
+                -1, list[2 * i], list[2 * i + 1]};
+        }
+        int l = 0;
+        int p = 0;
+        len = 0;
+        while (l < 256 || p < packages) {
+            if (p == packages || (l < 256 && pool[l].weight <= pool[first + p].weight)) {
+                merged[len++] = l++;
+            }
+            else {
+                merged[len++] = first + p++;
+            }
+        }
+        int * swap = list;
+        list = merged;
+        merged = swap;
+    }
+    memset(lengths, 0, 256);
+    for (int i = 0; i < 2 * 256 - 2; i++) {
+        count_leaves(pool, list[i], lengths);
+    }
+    free(list);
+    free(merged);
+    free(pool);
+}
+
+/*
+    Append the low count bits of value to out, first bit highest.
+*/
+static void put_bits(unsigned char * out, uint64_t * at, uint64_t value, int count) {
+    for (int i = count - 1; i >= 0; i--) {
+        if ((value >> i) & 1) {
+            out[*at / 8] |= 0x80 >> (*at % 8);
+        }
+        (*at)++;
+    }
+}
+/*
+    Write the dictionary with the given code lengths, its codes numbered canonically.
+*/
+static int write_dictionary(const char * path, const uint8_t lengths[256]) {
+    m_node dict[256];
+    uint64_t codes[256];
+    uint64_t bits = 0;
+    for (int i = 0; i < 256; i++) {
+        dict[i].code_l = lengths[i];
+        bits += 8 + lengths[i];
+    }
+    canonical_codes(dict, codes);
+    unsigned char * out = calloc((bits + 7) / 8, 1);
+    uint64_t at = 0;
+    for (int i = 0; i < 256; i++) {
+        put_bits(out, &at, lengths[i], 8);
+        put_bits(out, &at, codes[i], lengths[i]);
+    }
+    FILE * fp = fopen(path, "wb");
+    int ok = fp != NULL && fwrite(out, (bits + 7) / 8, 1, fp) == 1;
+    if (fp == NULL || fclose(fp) != 0 || !ok) {
+        perror(path);
+        ok = 0;
+    }
+    free(out);
+    return ok ? 0 : -1;
+}
+
+/*
+    Print the size the corpus encodes to with the code lengths given.
+*/
+static void report(const char * name, const uint64_t counts[256], const uint8_t lengths[256], uint64_t total) {
+    uint64_t bits = 0;
+    for (int i = 0; i < 256; i++) {
+        bits += counts[i] * lengths[i];
+    }
+    printf("  %-10s %lu bytes encoded, %.2f bits a byte, %.1f%% of the original\n", name,
+        (unsigned long) ((bits + 7) / 8), total ? (double) bits / total : 0.0,
+        total ? 100.0 * bits / 8 / total : 0.0);
+}
+/*
+    Train a dictionary on the files served, or on any files given, such as saved payloads:
+    count their bytes in parallel, give each byte the optimal code of at most -l bits
+    and write it in the format the server reads. Reports the size the corpus would
+    encode to with the trained dictionary and with the current one (-d).
+*/
+int main(int argc, char *argv[]) {
+    const char * current = "(sample)compression.dict";
+    int longest = TRAIN_LONGEST;
+    int opt;
+    int usage = 0;
+    while ((opt = getopt(argc, argv, "d:l:")) != -1) {
+        if (opt == 'd') {
+            current = optarg;
+        }
+        // 8 bits is the least that codes all 256 bytes.
+        else if (opt == 'l' && sscanf(optarg, "%d", &longest) == 1 && longest >= 8 && longest <= 32) {
+            continue;
+        }
+        else {
+            usage = 1;
+        }
+    }
+    if (usage || argc - optind < 2) {
+        printf("Usage: %s [-d current_dictionary] [-l longest_code] <output> <directory or file>...\n", argv[0]);
+        printf("Example: %s trained.dict ./files\n", argv[0]);
+        return 1;
+    }
+    corpus c;
+    memset(&c, 0, sizeof(c));
+    pthread_mutex_init(&c.lock, NULL);
+    for (int i = optind + 1; i < argc; i++) {
+        if (add_path(&c, argv[i]) == -1) {
+            return 1;
+        }
+    }
+    count_corpus(&c);
+    uint64_t total = 0;
+    for (int i = 0; i < 256; i++) {
+        total += c.counts[i];
+    }
+    uint8_t lengths[256];
+    limited_lengths(c.counts, longest, lengths);
+    if (write_dictionary(argv[optind], lengths) == -1) {
+        return 1;
+    }
+    int most = 0;
+    for (int i = 0; i < 256; i++) {
+        most = lengths[i] > most ? lengths[i] : most;
+    }
+    printf("Wrote %s, codes of up to %d bits, from %lu bytes\n", argv[optind], most, (unsigned long) total);
+    report("trained", c.counts, lengths, total);
+    m_node * dict;
+    if (read_map(&dict, current) == 0) {
+        uint8_t had[256];
+        for (int i = 0; i < 256; i++) {
+            had[i] = dict[i].code_l;
+        }
+        report("current", c.counts, had, total);
+        free_map(dict);
+    }
+    else {
+        printf("  %s could not be read to compare with\n", current);
+    }
+    for (int i = 0; i < c.nfiles; i++) {
+        free(c.files[i].path);
+    }
+    free(c.files);
+    free(c.starts);
+    return 0;
+}
\ No newline at end of file
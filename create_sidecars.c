@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "compression.h"
+#include "sidecar.h"
+#include "byteswap_compat.h"
+
+static void put_be64(unsigned char * p, uint64_t v) {
+    v = bswap_64(v);
+    memcpy(p, &v, 8);
+}
+/*
+    Encode one file of the directory and write its sidecar, through a temporary
+    file renamed into place so the server never sees half a sidecar.
+*/
+static int write_sidecar(const char * directory, const char * name, m_node ** dict) {
+    char path[4096];
+    char side[4096];
+    char tmp[4200];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    snprintf(side, sizeof(side), "%s/%s/%s", directory, SIDECAR_DIR, name);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", side);
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror(path);
+        return -1;
+    }
+    unsigned char * data = NULL;
+    if (st.st_size > 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+    }
+    // Encode a stride at a time, noting the bit offset each one starts at.
+    uint64_t entries = st.st_size / SIDECAR_STRIDE + 1;
+    unsigned char * head = malloc(SIDECAR_HEADER + 8 * entries);
+    encoder e;
+    encode_start(&e);
+    for (uint64_t i = 0; i < entries; i++) {
+        put_be64(head + SIDECAR_HEADER + 8 * i, e.bits);
+        uint64_t from = i * SIDECAR_STRIDE;
+        uint64_t len = st.st_size - from < SIDECAR_STRIDE ? st.st_size - from : SIDECAR_STRIDE;
+        encode(&e, data + from, len, dict);
+    }
+    if (e.bit != 8) {
+        // Clear the unused bits of the last byte.
+        e.buffer[e.length - 1] &= 0xff << e.bit;
+    }
+    memcpy(head, SIDECAR_MAGIC, 4);
+    uint32_t stride = bswap_32(SIDECAR_STRIDE);
+    memcpy(head + 4, &stride, 4);
+    put_be64(head + 8, st.st_size);
+    put_be64(head + 16, st.st_mtim.tv_sec);
+    put_be64(head + 24, st.st_mtim.tv_nsec);
+    put_be64(head + 32, dict_hash(dict));
+    put_be64(head + 40, e.bits);
+    put_be64(head + 48, entries);
+    FILE * fp = fopen(tmp, "wb");
+    int ok = fp != NULL && fwrite(head, SIDECAR_HEADER + 8 * entries, 1, fp) == 1 &&
+        (e.length == 0 || fwrite(e.buffer, e.length, 1, fp) == 1);
+    if (fp == NULL || fclose(fp) != 0 || !ok || rename(tmp, side) == -1) {
+        perror(side);
+        ok = 0;
+    }
+    else {
+        printf("  %s: %lu bytes, %lu encoded\n", name, (unsigned long) st.st_size, (unsigned long) e.length);
+    }
+    if (data != NULL) {
+        munmap(data, st.st_size);
+    }
+    close(fd);
+    free(head);
+    free(e.buffer);
+    return ok ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        printf("Usage: %s <directory>\n", argv[0]);
+        printf("Example: %s ./files\n", argv[0]);
+        return 1;
+    }
+    m_node * dict;
+    create_map(&dict);
+    char side[4096];
+    snprintf(side, sizeof(side), "%s/%s", argv[1], SIDECAR_DIR);
+    mkdir(side, 0755);
+    DIR * d = opendir(argv[1]);
+    if (d == NULL) {
+        perror("Failed to open directory");
+        return 1;
+    }
+    printf("Writing sidecars to '%s'\n", side);
+    int failed = 0;
+    struct dirent * de;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_type == DT_REG && write_sidecar(argv[1], de->d_name, &dict) == -1) {
+            failed++;
+        }
+    }
+    closedir(d);
+    return failed > 0;
+}
\ No newline at end of file
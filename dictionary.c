@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include "dictionary.h"
+#include "compression.h"
+
+/*
+    The dictionary in use, replaced whole on reload. Readers take no lock: a request
+    enters a read section by noting the current epoch in its thread's slot, reads
+    current once, and handles the whole message with that dictionary. A reload swaps
+    in the new dictionary, moves the epoch on, and waits until no slot is still in an
+    older epoch and no request holds the old dictionary, before freeing it. A section
+    blocks only on the sends of a reply too large for one batch, never on a parent.
+*/
+static dictionary * current = NULL;
+static unsigned long epoch = 1;
+static reader readers[DICTIONARY_SLOTS];
+// Readers in a section without a slot of their own.
+static unsigned long overflow = 0;
+static pthread_mutex_t reload_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t slot_key;
+static pthread_once_t slot_once = PTHREAD_ONCE_INIT;
+static __thread reader * mine = NULL;
+static __thread int claimed = 0;
+static __thread int depth = 0;
+
+static void slot_free(void * slot) {
+    reader * r = slot;
+    __atomic_store_n(&r->epoch, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&r->used, 0, __ATOMIC_RELEASE);
+}
+
+static void slot_key_create(void) {
+    pthread_key_create(&slot_key, slot_free);
+}
+/*
+    Take a free slot for the calling thread, given back when the thread exits.
+*/
+static void claim(void) {
+    claimed = 1;
+    pthread_once(&slot_once, slot_key_create);
+    for (int i = 0; i < DICTIONARY_SLOTS; i++) {
+        int unused = 0;
+        if (__atomic_compare_exchange_n(&readers[i].used, &unused, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            mine = &readers[i];
+            pthread_setspecific(slot_key, mine);
+            return;
+        }
+    }
+}
+/*
+    Enter a read section and return the current dictionary, which stays valid until
+    the matching dictionary_exit. Sections nest.
+*/
+m_node * dictionary_enter(void) {
+    if (depth++ == 0) {
+        if (!claimed) {
+            claim();
+        }
+        if (mine != NULL) {
+            __atomic_store_n(&mine->epoch, __atomic_load_n(&epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+        }
+        else {
+            __atomic_add_fetch(&overflow, 1, __ATOMIC_SEQ_CST);
+        }
+    }
+    return __atomic_load_n(&current, __ATOMIC_SEQ_CST)->map;
+}
+
+void dictionary_exit(void) {
+    if (--depth == 0) {
+        if (mine != NULL) {
+            __atomic_store_n(&mine->epoch, 0, __ATOMIC_RELEASE);
+        }
+        else {
+            __atomic_sub_fetch(&overflow, 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+/*
+    Keep the current dictionary for a request that outlives a read section, until
+    dictionary_put. The map is at &d->map.
+*/
+dictionary * dictionary_hold(void) {
+    dictionary_enter();
+    dictionary * d = __atomic_load_n(&current, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&d->holds, 1, __ATOMIC_RELAXED);
+    dictionary_exit();
+    return d;
+}
+
+void dictionary_put(dictionary * d) {
+    __atomic_sub_fetch(&d->holds, 1, __ATOMIC_RELEASE);
+}
+
+static void pause_briefly(void) {
+    struct timespec ts = {0, 1000000};
+    nanosleep(&ts, NULL);
+}
+/*
+    Wait until every read section open when the dictionary was swapped has ended.
+*/
+static void synchronize(void) {
+    unsigned long now = __atomic_add_fetch(&epoch, 1, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < DICTIONARY_SLOTS; i++) {
+        while (1) {
+            unsigned long seen = __atomic_load_n(&readers[i].epoch, __ATOMIC_SEQ_CST);
+            if (seen == 0 || seen >= now) {
+                break;
+            }
+            pause_briefly();
+        }
+    }
+    while (__atomic_load_n(&overflow, __ATOMIC_SEQ_CST) != 0) {
+        pause_briefly();
+    }
+}
+/*
+    Load the dictionary file again and swap it in. Requests already under way finish on
+    the dictionary they started with, which is freed, with its tables, once they have.
+    Returns -1, keeping the dictionary in use, if the file cannot be read.
+*/
+int dictionary_reload(void) {
+    m_node * map;
+    if (read_map(&map, DICTIONARY_PATH) == -1) {
+        fprintf(stderr, "Failed to reload compression dictionary, keeping the current one\n");
+        return -1;
+    }
+    // Build the tables here, rather than in the first request to use the dictionary.
+    dict_hash(&map);
+    dictionary * d = calloc(1, sizeof(dictionary));
+    d->map = map;
+    pthread_mutex_lock(&reload_lock);
+    dictionary * old = __atomic_exchange_n(&current, d, __ATOMIC_SEQ_CST);
+    synchronize();
+    while (__atomic_load_n(&old->holds, __ATOMIC_ACQUIRE) > 0) {
+        pause_briefly();
+    }
+    codebook_forget(old->map);
+    free_map(old->map);
+    free(old);
+    pthread_mutex_unlock(&reload_lock);
+    return 0;
+}
+/*
+    Reload the dictionary each time the server receives SIGHUP, taken here with
+    sigwait as every other thread blocks it.
+*/
+static void * reloader(void * args) {
+    sigset_t * set = args;
+    int sig;
+    while (sigwait(set, &sig) == 0) {
+        if (dictionary_reload() == 0) {
+            printf("Reloaded compression dictionary\n");
+            fflush(stdout);
+        }
+    }
+    return NULL;
+}
+/*
+    Load the dictionary and start the reloader. Called before any other thread is started,
+    so they all inherit SIGHUP blocked.
+*/
+void dictionary_start(void) {
+    current = calloc(1, sizeof(dictionary));
+    create_map(&current->map);
+    static sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    pthread_t t;
+    if (pthread_create(&t, NULL, reloader, &set) == 0) {
+        pthread_detach(t);
+    }
+}
+/*
+    Free the dictionary at shutdown. While a reload is under way it is left alone, as
+    the requests the reload waits on may never finish once the server stops.
+*/
+void dictionary_close(void) {
+    if (pthread_mutex_trylock(&reload_lock) != 0) {
+        return;
+    }
+    dictionary * d = __atomic_exchange_n(&current, NULL, __ATOMIC_SEQ_CST);
+    if (d != NULL) {
+        free_map(d->map);
+        free(d);
+    }
+    pthread_mutex_unlock(&reload_lock);
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+#include "tp.h"
+// The dictionary file, read at startup and again on SIGHUP.
+#define DICTIONARY_PATH "(sample)compression.dict"
+// Threads that can each have a read section of their own; any more share a counter.
+#define DICTIONARY_SLOTS 256
+/*
+    One loaded dictionary. holds counts requests that keep using it past the end of
+    a read section, waiting on io_uring completions.
+*/
+typedef struct dictionary {
+    m_node * map;
+    int holds;
+} dictionary;
+/*
+    The epoch a thread entered its read section in, 0 outside of one, on a cache line
+    of its own so readers never write to a line another reader writes.
+*/
+typedef struct reader {
+    unsigned long epoch;
+    int used;
+} __attribute__((aligned(64))) reader;
+void dictionary_start(void);
+m_node * dictionary_enter(void);
+void dictionary_exit(void);
+dictionary * dictionary_hold(void);
+void dictionary_put(dictionary * d);
+int dictionary_reload(void);
+void dictionary_close(void);
+#endif
\ No newline at end of file
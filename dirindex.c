@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "dirindex.h"
+#include "filecache.h"
+#include "compression.h"
+#include "byteswap_compat.h"
+
+/*
+    The index of the served directory, kept current by the file cache's inotify watcher.
+    It is only used while live: built, and with the directory watched. Otherwise every
+    lookup answers unknown and callers go to the file system themselves.
+*/
+static pthread_rwlock_t index_lock = PTHREAD_RWLOCK_INITIALIZER;
+static dir_entry * buckets[DIRINDEX_BUCKETS];
+static char * indexed = NULL;
+static int dirfd_index = -1;
+static int live = 0;
+/*
+    The listing responses for the directory as it stands, and the count of changes to
+    the set of listed names that they are checked against.
+*/
+static listing * frames = NULL;
+static unsigned long generation = 0;
+
+static unsigned int name_hash(const char * name) {
+    unsigned int h = 5381;
+    while (*name) {
+        h = h * 33 + (unsigned char) *name++;
+    }
+    return h % DIRINDEX_BUCKETS;
+}
+/*
+    Bring the entry for name in line with the directory. Called with the write lock held.
+*/
+static void refresh(const char * name) {
+    dir_entry ** p = &buckets[name_hash(name)];
+    while (*p != NULL && strcmp((*p)->name, name) != 0) {
+        p = &(*p)->next;
+    }
+    struct stat lst;
+    struct stat st;
+    // Listings take the entry's own type, sizes the file it resolves to.
+    int found = fstatat(dirfd_index, name, &lst, AT_SYMLINK_NOFOLLOW) == 0;
+    if (found && S_ISLNK(lst.st_mode)) {
+        found = fstatat(dirfd_index, name, &st, 0) == 0;
+    }
+    else {
+        st = lst;
+    }
+    if (!found) {
+        if (*p != NULL) {
+            dir_entry * gone = *p;
+            generation += gone->regular;
+            *p = gone->next;
+            free(gone->name);
+            free(gone);
+        }
+        return;
+    }
+    dir_entry * e = *p;
+    if (e == NULL) {
+        e = malloc(sizeof(dir_entry));
+        e->name = strdup(name);
+        e->next = buckets[name_hash(name)];
+        buckets[name_hash(name)] = e;
+        e->regular = 0;
+    }
+    e->size = st.st_size;
+    e->mtime = st.st_mtim;
+    e->mode = st.st_mode;
+    if (e->regular != S_ISREG(lst.st_mode)) {
+        e->regular = S_ISREG(lst.st_mode);
+        generation++;
+    }
+}
+
+static void clear(void) {
+    generation++;
+    for (int i = 0; i < DIRINDEX_BUCKETS; i++) {
+        while (buckets[i] != NULL) {
+            dir_entry * e = buckets[i];
+            buckets[i] = e->next;
+            free(e->name);
+            free(e);
+        }
+    }
+}
+/*
+    Read every name in the directory into the index. Called with the write lock held.
+*/
+static void scan(void) {
+    clear();
+    int fd = dup(dirfd_index);
+    DIR * d = fd == -1 ? NULL : fdopendir(fd);
+    if (d == NULL) {
+        if (fd != -1) {
+            close(fd);
+        }
+        live = 0;
+        return;
+    }
+    // The descriptor shares its position with the index's, start from the top.
+    rewinddir(d);
+    struct dirent * de;
+    while ((de = readdir(d)) != NULL) {
+        if (strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0) {
+            refresh(de->d_name);
+        }
+    }
+    closedir(d);
+}
+/*
+    Index the served directory. The directory is watched before it is read, so no
+    change made while reading is missed. If it cannot be watched no index is kept.
+*/
+void dirindex_build(const char * directory) {
+    // The watcher updates the index holding the file cache's lock, so watch without holding the index's.
+    int watched = filecache_watch(directory);
+    pthread_rwlock_wrlock(&index_lock);
+    indexed = strdup(directory);
+    dirfd_index = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    live = dirfd_index != -1 && watched;
+    if (live) {
+        scan();
+    }
+    pthread_rwlock_unlock(&index_lock);
+}
+/*
+    Look up a name in the served directory. Returns 1 and the size of the file if it
+    exists, 0 if it does not, and -1 if the index cannot tell.
+*/
+int dirindex_lookup(const char * name, uint64_t * size) {
+    pthread_rwlock_rdlock(&index_lock);
+    if (!live) {
+        pthread_rwlock_unlock(&index_lock);
+        return -1;
+    }
+    dir_entry * e = buckets[name_hash(name)];
+    while (e != NULL && strcmp(e->name, name) != 0) {
+        e = e->next;
+    }
+    if (e != NULL) {
+        *size = e->size;
+    }
+    pthread_rwlock_unlock(&index_lock);
+    return e != NULL;
+}
+/*
+    The names of the regular files in the served directory, each ending in a NUL,
+    or a single NUL if there are none. Called with the lock held, for reading at least.
+*/
+static unsigned char * listing_payload(uint64_t * length) {
+    uint64_t total = 0;
+    for (int i = 0; i < DIRINDEX_BUCKETS; i++) {
+        for (dir_entry * e = buckets[i]; e != NULL; e = e->next) {
+            if (e->regular) {
+                total += strlen(e->name) + 1;
+            }
+        }
+    }
+    unsigned char * buf = malloc(total == 0 ? 1 : total);
+    *length = total == 0 ? 1 : total;
+    buf[0] = '\0';
+    uint64_t at = 0;
+    for (int i = 0; i < DIRINDEX_BUCKETS; i++) {
+        for (dir_entry * e = buckets[i]; e != NULL; e = e->next) {
+            if (e->regular) {
+                size_t n = strlen(e->name) + 1;
+                memcpy(buf + at, e->name, n);
+                at += n;
+            }
+        }
+    }
+    return buf;
+}
+/*
+    Build a whole listing response, frame header included, from the payload given,
+    compressing it if asked. Called without the lock, so compression holds nobody up.
+*/
+static void build_frame(listing * l, int compressed, unsigned char * payload, uint64_t length,
+    m_node ** dict) {
+    message * msg = malloc(sizeof(message));
+    msg->buffer = payload;
+    msg->length = length;
+    if (compressed) {
+        compress(&msg, dict);
+    }
+    uint64_t net = bswap_64(msg->length);
+    l->frame[compressed] = malloc(9 + msg->length);
+    l->frame[compressed][0] = compressed ? 0b00111000 : 0b00110000;
+    memcpy(l->frame[compressed] + 1, &net, 8);
+    memcpy(l->frame[compressed] + 9, msg->buffer, msg->length);
+    l->length[compressed] = 9 + msg->length;
+    free(msg->buffer);
+    free(msg);
+}
+/*
+    Give back a listing taken with dirindex_listing, freeing it once the index has
+    replaced it and no reply still holds it.
+*/
+void dirindex_release(void * ref) {
+    listing * l = ref;
+    if (__atomic_sub_fetch(&l->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(l->frame[0]);
+        free(l->frame[1]);
+        free(l);
+    }
+}
+/*
+    The ready to send listing response for the served directory, compressed or not.
+    Responses are built on first request after the listed names (or for the compressed
+    one, the dictionary) change, and shared by every request until the next change. Returns NULL if the index cannot tell;
+    otherwise the listing must be given back with dirindex_release once sent.
+*/
+listing * dirindex_listing(int compressed, m_node ** dict) {
+    uint64_t hash = compressed ? dict_hash(dict) : 0;
+    pthread_rwlock_rdlock(&index_lock);
+    listing * l = frames;
+    if (!live) {
+        pthread_rwlock_unlock(&index_lock);
+        return NULL;
+    }
+    if (l != NULL && l->generation == generation && l->frame[compressed] != NULL &&
+        (!compressed || l->dict == hash)) {
+        __atomic_add_fetch(&l->refs, 1, __ATOMIC_RELAXED);
+        pthread_rwlock_unlock(&index_lock);
+        return l;
+    }
+    // Only the names are taken under the lock. The watcher updates the index inside the
+    // file cache's lock, so neither waits on the response being compressed.
+    unsigned long seen = generation;
+    uint64_t length;
+    unsigned char * payload = listing_payload(&length);
+    pthread_rwlock_unlock(&index_lock);
+    listing * built = calloc(1, sizeof(listing));
+    built->refs = 1;
+    built->generation = seen;
+    build_frame(built, compressed, payload, length, dict);
+    if (compressed) {
+        built->dict = hash;
+    }
+    pthread_rwlock_wrlock(&index_lock);
+    if (!live || generation != seen) {
+        // The names changed meanwhile: the response still answers this request, but is not kept.
+        pthread_rwlock_unlock(&index_lock);
+        return built;
+    }
+    if (frames != NULL && (frames->generation != generation ||
+        (compressed && frames->frame[1] != NULL && frames->dict != hash))) {
+        // The names or the dictionary changed, the index lets go of the old responses.
+        dirindex_release(frames);
+        frames = NULL;
+    }
+    if (frames == NULL) {
+        built->refs++;
+        frames = built;
+        pthread_rwlock_unlock(&index_lock);
+        return built;
+    }
+    // Keep the response with the other one for this state, unless a request racing this
+    // one has already put its own there.
+    l = frames;
+    if (l->frame[compressed] == NULL) {
+        l->frame[compressed] = built->frame[compressed];
+        l->length[compressed] = built->length[compressed];
+        built->frame[compressed] = NULL;
+        if (compressed) {
+            l->dict = hash;
+        }
+    }
+    dirindex_release(built);
+    __atomic_add_fetch(&l->refs, 1, __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&index_lock);
+    return l;
+}
+/*
+    A name in a watched directory changed; refresh it if the directory is the one indexed.
+*/
+void dirindex_update(const char * directory, const char * name) {
+    pthread_rwlock_wrlock(&index_lock);
+    if (live && strcmp(directory, indexed) == 0) {
+        refresh(name);
+    }
+    pthread_rwlock_unlock(&index_lock);
+}
+/*
+    Changes were lost, read the whole directory again.
+*/
+void dirindex_rescan(void) {
+    pthread_rwlock_wrlock(&index_lock);
+    if (live) {
+        scan();
+    }
+    pthread_rwlock_unlock(&index_lock);
+}
+/*
+    A watched directory is no longer watched; if it is the one indexed, stop using the index.
+*/
+void dirindex_lost(const char * directory) {
+    pthread_rwlock_wrlock(&index_lock);
+    if (indexed != NULL && strcmp(directory, indexed) == 0) {
+        live = 0;
+        clear();
+    }
+    pthread_rwlock_unlock(&index_lock);
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#ifndef DIRINDEX_H
+#define DIRINDEX_H
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include "message_handling.h"
+// Hash buckets of the index, keyed by file name.
+#define DIRINDEX_BUCKETS 1024
+/*
+    What the index knows about one name in the served directory: the size and
+    modification time it resolves to, and whether the entry itself is a regular file.
+*/
+typedef struct dir_entry {
+    char * name;
+    uint64_t size;
+    struct timespec mtime;
+    mode_t mode;
+    int regular;
+    struct dir_entry * next;
+} dir_entry;
+/*
+    Ready to send listing responses, uncompressed and compressed, for one state of the
+    directory, and the hash of the dictionary the compressed one was encoded with.
+    Shared by the index and the replies sending them, and freed by the last.
+*/
+typedef struct listing {
+    int refs;
+    unsigned long generation;
+    uint64_t dict;
+    unsigned char * frame[2];
+    uint64_t length[2];
+} listing;
+void dirindex_build(const char * directory);
+int dirindex_lookup(const char * name, uint64_t * size);
+listing * dirindex_listing(int compressed, m_node ** dict);
+void dirindex_release(void * ref);
+void dirindex_update(const char * directory, const char * name);
+void dirindex_rescan(void);
+void dirindex_lost(const char * directory);
+#endif
\ No newline at end of file
@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include "encpool.h"
+#include "filecache.h"
+
+/*
+    Threads encoding and decoding chunks of large payloads, one per core besides the thread asking,
+    taking chunks from a shared queue. A thread waiting on its own chunks works through
+    the queue as well, so no batch waits on a busy pool while its caller sits idle.
+*/
+size_t encpool_min = ENCPOOL_MIN;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t finished = PTHREAD_COND_INITIALIZER;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static enc_chunk * head = NULL;
+static enc_chunk * tail = NULL;
+static int workers = 0;
+/*
+    Encode a chunk on its own, from bit 0, under the calling thread's SIGBUS guard,
+    since the input may be a mapping of a file truncated meanwhile. A part of a
+    payload being decoded is in memory already.
+*/
+static void run_chunk(enc_chunk * c) {
+    sigjmp_buf jb;
+    if (c->part != NULL) {
+        decompress_part(c->input, c->dict, c->part);
+    }
+    else if (sigsetjmp(jb, 1) != 0) {
+        c->fault = 1;
+    }
+    else {
+        filecache_guard(&jb);
+        encode(&c->out, c->data, c->length, c->dict);
+    }
+    filecache_guard(NULL);
+    pthread_mutex_lock(&pool_lock);
+    if (--*c->pending == 0) {
+        pthread_cond_broadcast(&finished);
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
+/*
+    Take the next queued chunk. Called with the lock held.
+*/
+static enc_chunk * take(void) {
+    enc_chunk * c = head;
+    if (c != NULL) {
+        head = c->next;
+        if (head == NULL) {
+            tail = NULL;
+        }
+    }
+    return c;
+}
+
+static void * pool_worker(void * args) {
+    (void) args;
+    pthread_mutex_lock(&pool_lock);
+    while (1) {
+        enc_chunk * c = take();
+        if (c == NULL) {
+            pthread_cond_wait(&queued, &pool_lock);
+            continue;
+        }
+        pthread_mutex_unlock(&pool_lock);
+        run_chunk(c);
+        pthread_mutex_lock(&pool_lock);
+    }
+    return NULL;
+}
+
+static void pool_start(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int wanted = cores > ENCPOOL_THREADS + 1 ? ENCPOOL_THREADS : (int) cores - 1;
+    for (int i = 0; i < wanted; i++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, pool_worker, NULL) != 0) {
+            break;
+        }
+        pthread_detach(t);
+        workers++;
+    }
+}
+/*
+    How many chunks to cut a payload of length bytes into, 1 when it is not worth it,
+    which a payload shorter than a chunk never is, whatever encpool_min says.
+*/
+static int chunk_count(uint64_t length) {
+    if (encpool_min == 0 || length < encpool_min) {
+        return 1;
+    }
+    pthread_once(&pool_once, pool_start);
+    if (length / (workers + 1) < ENCPOOL_CHUNK) {
+        return length / ENCPOOL_CHUNK > 0 ? length / ENCPOOL_CHUNK : 1;
+    }
+    return workers + 1;
+}
+/*
+    Run a batch of chunks, the first on the calling thread and the rest on the pool,
+    and wait for all of them.
+*/
+static void run_batch(enc_chunk * chunks, int count) {
+    int pending = count;
+    for (int i = 0; i < count; i++) {
+        chunks[i].pending = &pending;
+        chunks[i].next = NULL;
+    }
+    if (count > 1) {
+        pthread_mutex_lock(&pool_lock);
+        for (int i = 1; i < count; i++) {
+            if (tail == NULL) {
+                head = &chunks[i];
+            }
+            else {
+                tail->next = &chunks[i];
+            }
+            tail = &chunks[i];
+        }
+        pthread_cond_broadcast(&queued);
+        pthread_mutex_unlock(&pool_lock);
+    }
+    run_chunk(&chunks[0]);
+    pthread_mutex_lock(&pool_lock);
+    while (pending > 0) {
+        enc_chunk * c = take();
+        if (c == NULL) {
+            pthread_cond_wait(&finished, &pool_lock);
+            continue;
+        }
+        pthread_mutex_unlock(&pool_lock);
+        run_chunk(c);
+        pthread_mutex_lock(&pool_lock);
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
+/*
+    Append the encoding of length bytes to e. A payload of at least encpool_min bytes is
+    cut into a chunk per thread, which are encoded at once, each from bit 0, and joined
+    by appending each after the bits of those before it. The codes of a byte do not
+    depend on its neighbours, so this is the encoding of the whole payload at one go.
+    Returns 0 if reading the input raised SIGBUS, leaving e partly appended to.
+*/
+int encpool_encode(encoder * e, const unsigned char * data, uint64_t length, m_node ** dict) {
+    enc_chunk chunks[ENCPOOL_THREADS + 1];
+    int count = chunk_count(length);
+    uint64_t size = length / count;
+    for (int i = 0; i < count; i++) {
+        chunks[i].data = data + i * size;
+        chunks[i].length = i == count - 1 ? length - i * size : size;
+        chunks[i].dict = dict;
+        chunks[i].fault = 0;
+        chunks[i].part = NULL;
+        encode_start(&chunks[i].out);
+    }
+    // The first chunk is encoded straight onto e.
+    chunks[0].out = *e;
+    run_batch(chunks, count);
+    *e = chunks[0].out;
+    int fault = chunks[0].fault;
+    for (int i = 1; i < count; i++) {
+        fault |= chunks[i].fault;
+        if (!fault) {
+            encode_append(e, chunks[i].out.buffer, 0, chunks[i].out.bits);
+        }
+        free(chunks[i].out.buffer);
+    }
+    return !fault;
+}
+/*
+    Decode a compressed payload in place, as decompress does. A payload of at least
+    encpool_min bytes is cut into a part per thread, each decoded at once from its
+    first bit on the guess that a code starts there, and the parts are then checked
+    against where the part before really ended and put together.
+*/
+void encpool_decode(message ** input, m_node ** dict) {
+    int count = chunk_count((*input)->length);
+    decode_part * parts = count > 1 ? malloc(count * sizeof(decode_part)) : NULL;
+    if (parts == NULL || !decompress_split(*input, dict, parts, count)) {
+        free(parts);
+        decompress(input, dict);
+        return;
+    }
+    enc_chunk chunks[ENCPOOL_THREADS + 1];
+    for (int i = 0; i < count; i++) {
+        chunks[i].dict = dict;
+        chunks[i].input = *input;
+        chunks[i].part = &parts[i];
+    }
+    run_batch(chunks, count);
+    decompress_join(input, dict, parts, count);
+    free(parts);
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#ifndef ENCPOOL_H
+#define ENCPOOL_H
+#include <stdint.h>
+#include <stddef.h>
+#include "compression.h"
+// Most threads encoding chunks besides the caller.
+#define ENCPOOL_THREADS 63
+// Chunks are never made shorter than this.
+#define ENCPOOL_CHUNK (1UL << 20)
+// Default smallest payload split across the pool, encoded or decoded.
+#define ENCPOOL_MIN (8UL << 20)
+/*
+    One piece of a payload being encoded, or with part set, decoded, and the batch it
+    belongs to. fault is set if reading the input raised SIGBUS.
+*/
+typedef struct enc_chunk {
+    const unsigned char * data;
+    uint64_t length;
+    m_node ** dict;
+    encoder out;
+    int fault;
+    message * input;
+    decode_part * part;
+    int * pending;
+    struct enc_chunk * next;
+} enc_chunk;
+extern size_t encpool_min;
+int encpool_encode(encoder * e, const unsigned char * data, uint64_t length, m_node ** dict);
+void encpool_decode(message ** input, m_node ** dict);
+#endif
\ No newline at end of file
@@ -0,0 +1,443 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "filecache.h"
+#include "dirindex.h"
+
+size_t filecache_budget = FILECACHE_BUDGET;
+/*
+    The process wide cache: hash chains by path, and a list from least to most recently
+    used for eviction. files counts the open files in the cache, and mapped the bytes of
+    their mappings. changes counts the changes reported by inotify.
+*/
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static file_map * buckets[FILECACHE_BUCKETS];
+static file_map * oldest = NULL;
+static file_map * newest = NULL;
+static int files = 0;
+static size_t mapped = 0;
+static unsigned long changes = 0;
+/*
+    The directories of cached files watched with inotify, by watch descriptor.
+*/
+static int notify_fd = -1;
+static int watch_wd[FILECACHE_DIRS];
+static char * watch_dir[FILECACHE_DIRS];
+static int watches = 0;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+/*
+    Where a thread reading a mapping jumps to if the file was truncated underneath it.
+*/
+static __thread sigjmp_buf * guard = NULL;
+
+static unsigned int path_hash(const char * path) {
+    unsigned int h = 5381;
+    while (*path) {
+        h = h * 33 + (unsigned char) *path++;
+    }
+    return h % FILECACHE_BUCKETS;
+}
+/*
+    Reading a mapped page past the end of a truncated file raises SIGBUS. A guarded
+    reader jumps back to its fallback; anywhere else the signal keeps its default action.
+    The handler runs with SIGBUS unblocked, so a thread that jumped out of it catches
+    its next fault too, rather than having it forced on the process with SIGBUS blocked.
+*/
+static void on_sigbus(int sig) {
+    if (guard != NULL) {
+        siglongjmp(*guard, 1);
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+/*
+    Arm (or with NULL, disarm) the calling thread's SIGBUS fallback around reads of a mapping.
+    The fallback is set with sigsetjmp(jb, 1), so jumping to it restores the signal mask.
+*/
+void filecache_guard(sigjmp_buf * jb) {
+    guard = jb;
+}
+/*
+    Take a file out of the hash chain and the use list, so no new reader finds it.
+    Called with the lock held.
+*/
+static void unlink_map(file_map * m) {
+    file_map ** p = &buckets[path_hash(m->path)];
+    while (*p != NULL && *p != m) {
+        p = &(*p)->next;
+    }
+    if (*p == m) {
+        *p = m->next;
+    }
+    if (m->older != NULL) {
+        m->older->newer = m->newer;
+    }
+    else {
+        oldest = m->newer;
+    }
+    if (m->newer != NULL) {
+        m->newer->older = m->older;
+    }
+    else {
+        newest = m->older;
+    }
+    m->older = NULL;
+    m->newer = NULL;
+    files--;
+    mapped -= m->length;
+    m->stale = 1;
+}
+
+static void push_newest(file_map * m) {
+    m->older = newest;
+    m->newer = NULL;
+    if (newest != NULL) {
+        newest->newer = m;
+    }
+    else {
+        oldest = m;
+    }
+    newest = m;
+}
+/*
+    Move a file to the most recently used end of the list. Called with the lock held.
+*/
+static void touch(file_map * m) {
+    if (m == newest) {
+        return;
+    }
+    if (m->older != NULL) {
+        m->older->newer = m->newer;
+    }
+    else {
+        oldest = m->newer;
+    }
+    m->newer->older = m->older;
+    push_newest(m);
+}
+
+static void destroy_map(file_map * m) {
+    if (m->data != NULL) {
+        munmap(m->data, m->length);
+    }
+    close(m->fd);
+    free(m->path);
+    free(m);
+}
+/*
+    Drop a file from the cache, closing it now if nobody is reading it. Called with the lock held.
+*/
+static void drop(file_map * m) {
+    unlink_map(m);
+    if (m->refs == 0) {
+        destroy_map(m);
+    }
+}
+/*
+    Close the least recently used files nobody is reading until the cache fits its limits.
+    Called with the lock held.
+*/
+static void evict(void) {
+    file_map * m = oldest;
+    while (m != NULL && (mapped > filecache_budget || files > FILECACHE_FILES)) {
+        file_map * next = m->newer;
+        if (m->refs == 0) {
+            drop(m);
+        }
+        m = next;
+    }
+}
+
+static file_map * lookup(const char * path) {
+    file_map * m = buckets[path_hash(path)];
+    while (m != NULL && strcmp(m->path, path) != 0) {
+        m = m->next;
+    }
+    return m;
+}
+
+static int same_file(file_map * m, struct stat * st) {
+    return m->st.st_dev == st->st_dev && m->st.st_ino == st->st_ino && m->st.st_size == st->st_size &&
+        m->st.st_mtim.tv_sec == st->st_mtim.tv_sec && m->st.st_mtim.tv_nsec == st->st_mtim.tv_nsec;
+}
+/*
+    Drop every cached file under dir, or every cached file when dir is NULL. Called with the lock held.
+*/
+static void drop_dir(const char * dir) {
+    size_t n = dir == NULL ? 0 : strlen(dir);
+    file_map * m = oldest;
+    while (m != NULL) {
+        file_map * next = m->newer;
+        if (dir == NULL || (strncmp(m->path, dir, n) == 0 && m->path[n] == '/')) {
+            drop(m);
+        }
+        m = next;
+    }
+}
+/*
+    Waits on inotify for changes to the watched directories, drops the cached file each
+    change concerns and updates the directory index. If events were lost every cached
+    file is dropped and the index is read again.
+*/
+static void * watcher(void * arg) {
+    (void) arg;
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (1) {
+        ssize_t n = read(notify_fd, events, sizeof(events));
+        if (n <= 0) {
+            continue;
+        }
+        pthread_mutex_lock(&cache_lock);
+        __atomic_add_fetch(&changes, 1, __ATOMIC_RELEASE);
+        for (char * p = events; p < events + n; p += sizeof(struct inotify_event) + ((struct inotify_event *) p)->len) {
+            struct inotify_event * ev = (struct inotify_event *) p;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                drop_dir(NULL);
+                dirindex_rescan();
+                continue;
+            }
+            int i = 0;
+            while (i < watches && watch_wd[i] != ev->wd) {
+                i++;
+            }
+            if (i == watches) {
+                continue;
+            }
+            if (ev->mask & IN_IGNORED) {
+                // The directory itself went away, so did the watch.
+                drop_dir(watch_dir[i]);
+                dirindex_lost(watch_dir[i]);
+                watch_wd[i] = -1;
+                continue;
+            }
+            if (ev->len > 0) {
+                char path[4096];
+                snprintf(path, sizeof(path), "%s/%s", watch_dir[i], ev->name);
+                file_map * m = lookup(path);
+                if (m != NULL) {
+                    drop(m);
+                }
+                dirindex_update(watch_dir[i], ev->name);
+            }
+        }
+        pthread_mutex_unlock(&cache_lock);
+    }
+    return NULL;
+}
+
+static void init(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigbus;
+    sa.sa_flags = SA_NODEFER;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGBUS, &sa, NULL);
+    notify_fd = inotify_init1(IN_CLOEXEC);
+    if (notify_fd != -1) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, watcher, NULL) != 0) {
+            close(notify_fd);
+            notify_fd = -1;
+            return;
+        }
+        pthread_detach(t);
+    }
+}
+/*
+    Watch a directory, if it is not already. Returns 1 if the directory is watched,
+    0 if changes to its files have to be found with stat. Called with the lock held.
+*/
+static int watch_locked(const char * dir) {
+    if (notify_fd == -1) {
+        return 0;
+    }
+    for (int i = 0; i < watches; i++) {
+        if (strcmp(watch_dir[i], dir) == 0) {
+            return watch_wd[i] != -1;
+        }
+    }
+    if (watches == FILECACHE_DIRS) {
+        return 0;
+    }
+    watch_wd[watches] = inotify_add_watch(notify_fd, dir, IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE |
+        IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+    watch_dir[watches] = strdup(dir);
+    return watch_wd[watches++] != -1;
+}
+/*
+    Watch the directory holding path. Called with the lock held.
+*/
+static int watch(const char * path) {
+    const char * slash = strrchr(path, '/');
+    char * dir = slash == NULL ? strdup(".") : strndup(path, slash - path);
+    int watched = watch_locked(dir);
+    free(dir);
+    return watched;
+}
+/*
+    The count of changes reported in watched directories, which moves on whenever any of
+    them changes, for callers keeping their own results until then.
+*/
+unsigned long filecache_changes(void) {
+    return __atomic_load_n(&changes, __ATOMIC_ACQUIRE);
+}
+/*
+    Watch a directory for changes, so cached files in it and the directory index are
+    kept current. Returns 1 if it is watched.
+*/
+int filecache_watch(const char * directory) {
+    pthread_once(&init_once, init);
+    pthread_mutex_lock(&cache_lock);
+    int watched = watch_locked(directory);
+    pthread_mutex_unlock(&cache_lock);
+    return watched;
+}
+/*
+    Get the open file at path, opening it if the cache has no current one. A file in a
+    watched directory is returned without any system call; otherwise it is checked with
+    stat, so a replaced or rewritten file is opened afresh. Returns NULL if the path is not
+    a regular file that can be opened. Every file returned must be given back with
+    filecache_release.
+*/
+file_map * filecache_acquire(const char * path) {
+    pthread_once(&init_once, init);
+    pthread_mutex_lock(&cache_lock);
+    file_map * m = lookup(path);
+    if (m != NULL && !m->watched) {
+        // No watch, compare the file at path against the one cached.
+        unsigned long seen = changes;
+        pthread_mutex_unlock(&cache_lock);
+        struct stat st;
+        int found = stat(path, &st) == 0;
+        pthread_mutex_lock(&cache_lock);
+        file_map * now = lookup(path);
+        if (now == m && (!found || !same_file(m, &st))) {
+            drop(m);
+            m = NULL;
+        }
+        else if (now == m && seen == changes) {
+            m->watched = watch(path);
+        }
+        else {
+            m = now;
+        }
+    }
+    if (m != NULL) {
+        m->refs++;
+        m->uses++;
+        touch(m);
+        // A file in steady demand is read ahead in full, on huge pages where the kernel allows.
+        if (m->uses == FILECACHE_HOT && m->data != NULL) {
+            madvise(m->data, m->length, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+            madvise(m->data, m->length, MADV_HUGEPAGE);
+#endif
+        }
+        pthread_mutex_unlock(&cache_lock);
+        return m;
+    }
+    // Watch before opening, so no change after the open goes unseen.
+    int watched = watch(path);
+    unsigned long seen = changes;
+    pthread_mutex_unlock(&cache_lock);
+    // Open outside the lock, so a cold file does not stall readers of other files.
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return NULL;
+    }
+    m = malloc(sizeof(file_map));
+    if (fstat(fd, &m->st) == -1 || !S_ISREG(m->st.st_mode)) {
+        close(fd);
+        free(m);
+        return NULL;
+    }
+    m->path = strdup(path);
+    m->fd = fd;
+    m->data = NULL;
+    m->length = 0;
+    m->refs = 1;
+    m->stale = 0;
+    m->uses = 1;
+    m->older = NULL;
+    m->newer = NULL;
+    pthread_mutex_lock(&cache_lock);
+    // A change seen while opening may have been to this file, so check it with stat next time.
+    m->watched = watched && seen == changes;
+    // Another reader may have opened the same file meanwhile, replace it.
+    file_map * other = lookup(path);
+    if (other != NULL) {
+        drop(other);
+    }
+    m->next = buckets[path_hash(path)];
+    buckets[path_hash(path)] = m;
+    files++;
+    push_newest(m);
+    evict();
+    pthread_mutex_unlock(&cache_lock);
+    return m;
+}
+/*
+    The contents of a cached file, mapped read only on first use and shared by every reader.
+    Returns NULL if the file is empty or cannot be mapped.
+*/
+const unsigned char * filecache_data(file_map * m) {
+    pthread_mutex_lock(&cache_lock);
+    unsigned char * data = m->data;
+    pthread_mutex_unlock(&cache_lock);
+    if (data != NULL || m->st.st_size == 0) {
+        return data;
+    }
+    int flags = MAP_SHARED | ((size_t) m->st.st_size <= FILECACHE_POPULATE ? MAP_POPULATE : 0);
+    data = mmap(NULL, m->st.st_size, PROT_READ, flags, m->fd, 0);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    pthread_mutex_lock(&cache_lock);
+    if (m->data == NULL) {
+        m->data = data;
+        m->length = m->st.st_size;
+        if (!m->stale) {
+            mapped += m->length;
+            evict();
+        }
+    }
+    else {
+        // Another reader mapped it first.
+        munmap(data, m->st.st_size);
+        data = m->data;
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return data;
+}
+/*
+    Give back a file. A stale file is closed with its last reader,
+    and the cache is trimmed to its limits.
+*/
+void filecache_release(file_map * m) {
+    pthread_mutex_lock(&cache_lock);
+    m->refs--;
+    if (m->refs == 0 && m->stale) {
+        destroy_map(m);
+    }
+    else {
+        evict();
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+/*
+    Drop a file from the cache, after a read found it truncated.
+*/
+void filecache_invalidate(file_map * m) {
+    pthread_mutex_lock(&cache_lock);
+    if (!m->stale) {
+        unlink_map(m);
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+#include <stddef.h>
+#include <setjmp.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+// Hash buckets of the cache, keyed by path.
+#define FILECACHE_BUCKETS 256
+// Most files the cache keeps open at once.
+#define FILECACHE_FILES 1024
+// Most directories watched for changes to cached files.
+#define FILECACHE_DIRS 16
+// Default cap on the bytes mapped by the cache.
+#define FILECACHE_BUDGET (1UL << 30)
+// Files up to this size are prefaulted when mapped.
+#define FILECACHE_POPULATE (4UL << 20)
+// Uses after which a mapping is hinted as hot.
+#define FILECACHE_HOT 16
+/*
+    An open served file, shared by every connection reading it: the descriptor, the stat
+    taken when it was opened, and a read only mapping made on first use. While the file's
+    directory is watched with inotify a cached file is used without any system call, and
+    a change to the file marks it stale. A stale file is dropped from the cache, and closed
+    and unmapped once the last reader releases it.
+*/
+typedef struct file_map {
+    char * path;
+    int fd;
+    struct stat st;
+    int watched;
+    unsigned char * data;
+    size_t length;
+    int refs;
+    int stale;
+    unsigned long uses;
+    struct file_map * next;
+    struct file_map * older;
+    struct file_map * newer;
+} file_map;
+extern size_t filecache_budget;
+file_map * filecache_acquire(const char * path);
+const unsigned char * filecache_data(file_map * m);
+void filecache_release(file_map * m);
+void filecache_invalidate(file_map * m);
+void filecache_guard(sigjmp_buf * jb);
+int filecache_watch(const char * directory);
+unsigned long filecache_changes(void);
+#endif
\ No newline at end of file
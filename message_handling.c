@@ -14,6 +14,12 @@
 #include <dirent.h>
 #include "compression.h"
 #include "multiplexlist.h"
+#include "filecache.h"
+#include "dirindex.h"
+#include "segcache.h"
+#include "sidecar.h"
+#include "dictionary.h"
+#include "encpool.h"
 #include <sys/select.h>
 #define _GNU_SOURCE
 /*
@@ -37,122 +43,238 @@ void get_config (char * file_name, struct sockaddr_in * main, char ** directory)
     close(fd);
 }
 /*
-    Get Description finds and appropriately separates the contents of the message header.
-    Uses bit shifting (4, 3 and 2 bits to the right). A message structure exists
-    for this purpose. Has field describings describing type, length
-    and compression settings. Decompresses message where required.
+    Create the state for a newly accepted client. The receive buffer is only
+    allocated once the client sends something.
 */
-message * get_description(int sockfd, m_node ** compress) {
-    
-    unsigned char header;
-    if (read(sockfd, &header, 1) == 0) {
-        close(sockfd);
+connection * connection_create(int sockfd) {
+    connection * cl = malloc(sizeof(connection));
+    if (cl == NULL) {
         return NULL;
     }
-    message * msg;
-    msg = malloc(sizeof(message));
-    msg->buffer = NULL;
-    msg->main.type = (header >> 4);
-    if (msg->main.type == 0x8 || (msg->main.type != 0 && msg->main.type != 2 && 
-                msg->main.type != 4 && msg->main.type != 6 && msg->main.type != 8)) {
-        return msg;
-    }
-    /* 
-    Shift for setting fields appropriately
-    in the bit field.
-    */
-    msg->main.compression = (header >> 3);
-    msg->main.requires_compression = (header >> 2);
-    msg->length = 0;
-    read(sockfd, &msg->length, 8);
-    msg->length = bswap_64(msg->length);
-    if (msg->length > 0) {
-        msg->buffer = malloc(msg->length);
-        read(sockfd, msg->buffer, msg->length);
-    }
-    /* 
+    cl->fd = sockfd;
+    cl->in.stage = PARSE_HEADER;
+    cl->in.got = 0;
+    cl->in.msg = NULL;
+    cl->in.in = NULL;
+    cl->in.in_len = 0;
+    cl->in.in_pos = 0;
+    reply_init(&cl->out, sockfd);
+    cl->wait = NULL;
+    cl->closing = 0;
+    return cl;
+}
+/*
+    Send any queued responses, then close a client's socket and free its state,
+    including any partly received frame.
+*/
+void connection_close(connection * cl) {
+    reply_close(&cl->out);
+    close(cl->fd);
+    if (cl->in.msg != NULL) {
+        free(cl->in.msg->buffer);
+        free(cl->in.msg);
+    }
+    free(cl->in.in);
+    child_unpark(cl);
+    free(cl);
+}
+/*
+    Advance the parser over the bytes already received. Returns the message once a
+    whole frame has been parsed, or NULL once the buffered bytes run out mid frame.
+    Uses bit shifting (4, 3 and 2 bits to the right) to separate the header fields.
+    The payload is left as received, for decode_payload.
+*/
+static message * parse_frame(parser * p) {
+    if (p->stage == PARSE_HEADER) {
+        if (p->in_pos == p->in_len) {
+            return NULL;
+        }
+        unsigned char header = p->in[p->in_pos++];
+        message * msg = malloc(sizeof(message));
+        msg->buffer = NULL;
+        msg->length = 0;
+        msg->main.type = (header >> 4);
+        // Shutdown and unknown types are acted on without reading a length.
+        if (msg->main.type == 0x8 || (msg->main.type != 0 && msg->main.type != 2 && 
+                    msg->main.type != 4 && msg->main.type != 6 && msg->main.type != 8)) {
+            return msg;
+        }
+        msg->main.compression = (header >> 3);
+        msg->main.requires_compression = (header >> 2);
+        p->msg = msg;
+        p->got = 0;
+        p->stage = PARSE_LENGTH;
+    }
+    message * msg = p->msg;
+    if (p->stage == PARSE_LENGTH) {
+        size_t n = p->in_len - p->in_pos;
+        if (n > 8 - p->got) {
+            n = 8 - p->got;
+        }
+        memcpy(p->length + p->got, p->in + p->in_pos, n);
+        p->got += n;
+        p->in_pos += n;
+        if (p->got < 8) {
+            return NULL;
+        }
+        memcpy(&msg->length, p->length, 8);
+        msg->length = bswap_64(msg->length);
+        if (msg->length > 0) {
+            msg->buffer = malloc(msg->length);
+            // A length too large to buffer is answered as an unknown type.
+            if (msg->buffer == NULL) {
+                msg->main.type = 0x1;
+                p->msg = NULL;
+                p->stage = PARSE_HEADER;
+                return msg;
+            }
+        }
+        p->got = 0;
+        p->stage = PARSE_PAYLOAD;
+    }
+    size_t n = p->in_len - p->in_pos;
+    if (n > msg->length - p->got) {
+        n = msg->length - p->got;
+    }
+    memcpy(msg->buffer + p->got, p->in + p->in_pos, n);
+    p->got += n;
+    p->in_pos += n;
+    if (p->got < msg->length) {
+        return NULL;
+    }
+    p->msg = NULL;
+    p->stage = PARSE_HEADER;
+    return msg;
+}
+/*
+    Get the next message from a client. Frames already buffered are parsed first, so
+    one receive serves every frame pipelined into it. Returns 1 with the message in out,
+    0 once the client has hung up, and -1 when a receive with MSG_DONTWAIT in flags
+    would block, leaving any partial frame in the parser for the next call. -1 is also
+    returned, with any frames left buffered, while a non-blocking socket has no room
+    for the responses queued so far, so a client is not read from faster than it reads.
+*/
+int get_description(connection * cl, message ** out, int flags) {
+    parser * p = &cl->in;
+    while (1) {
+        // Nothing is queued behind a file range left over, and a message always has room.
+        if ((cl->out.file_left > 0 || cl->out.count > REPLY_IOV - REPLY_ROOM) &&
+            reply_flush(&cl->out) == 1) {
+            return -1;
+        }
+        if ((*out = parse_frame(p)) != NULL) {
+            return 1;
+        }
+        // Responses to the frames parsed so far go out before waiting on the client.
+        if ((cl->out.count > 0 || cl->out.nheld > 0) && reply_flush(&cl->out) == 1) {
+            return -1;
+        }
+        // The buffer has been consumed, so it is refilled from the start.
+        ssize_t n;
+        int direct = p->stage == PARSE_PAYLOAD && p->msg->length - p->got >= PARSER_BUFFER;
+        if (direct) {
+            // Large payloads are received straight into the message buffer.
+            n = recv(cl->fd, p->msg->buffer + p->got, p->msg->length - p->got, flags);
+        }
+        else {
+            if (p->in == NULL) {
+                p->in = malloc(PARSER_BUFFER);
+            }
+            n = recv(cl->fd, p->in, PARSER_BUFFER, flags);
+        }
+        if (n > 0) {
+            if (direct) {
+                p->got += n;
+                p->in_len = 0;
+            }
+            else {
+                p->in_len = n;
+            }
+            p->in_pos = 0;
+            continue;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Idle clients between frames keep no receive buffer.
+            if (p->stage == PARSE_HEADER) {
+                free(p->in);
+                p->in = NULL;
+            }
+            p->in_len = 0;
+            p->in_pos = 0;
+            return -1;
+        }
+        return 0;
+    }
+}
+/*
     Decompress the payload if the type is not echo
     and payload already compressed.
-    */
+*/
+void decode_payload(message * msg, m_node ** compress) {
     if (msg->main.compression == 1) {
         if (msg->main.type == 0) {
             if (msg->main.requires_compression != 1) {
-                decompress(&msg, compress);
+                encpool_decode(&msg, compress);
             }
         }
         else {
-            decompress(&msg, compress);
+            encpool_decode(&msg, compress);
         }
     }
-    return msg;
 }
 /*
-    Sends header containing appropraite error bits.
+    Queues header containing appropraite error bits.
 */
-void error_send(int sockfd) {
-    char header = 0b11110000;
-    uint64_t a = 0;
-    send(sockfd, &header, 1, 0);
-    send(sockfd, &a, 8, 0);
+void error_send(reply * out) {
+    reply_frame(out, 0b11110000, NULL, 0, 0);
 }
 /*
     Send back the contents of the payload and compress where appropriate.
 */
-void echo(int sockfd, message * input, m_node ** compressor) {
-    char * full = NULL;
-    full = malloc(input->length + 9);
+void echo(reply * out, message * input, m_node ** compressor) {
     // Compress where requires compression set and compression not already set.
-    if (input->main.requires_compression == 1) {
-        // Set the message header appropriately (depending on compression).
-        full[0] =  0b00011000;
-        if (input->main.compression == 0) {
-            compress(&input, compressor);
-        }
-    }
-    else {
-        // Set the message header appropriately (depending on compression).
-        full[0] =  0b00010000;
-    }
-    uint64_t to_send = bswap_64(input->length);
-    memcpy(full + 1, &to_send, 8);
-    if (input->length > 0) {
-        memcpy(full + 9, input->buffer, input->length);
+    if (input->main.requires_compression == 1 && input->main.compression == 0) {
+        compress(&input, compressor);
     }
-    send(sockfd, full, input->length + 9, 0);
-    free(full);
+    // Set the message header appropriately (depending on compression).
+    unsigned char header = input->main.requires_compression == 1 ? 0b00011000 : 0b00010000;
+    // The payload moves to the reply, which frees it once sent.
+    reply_frame(out, header, input->buffer, input->length, 1);
+    input->buffer = NULL;
 }
 /*
     Takes in the message for the file, and calculates the file size
     using the stat library. Compress where appropriate. Takes in compression struct.
 */
-void file_size_response(int sockfd, message ** input, char * directory, m_node ** compressor) {
-    // Validate filename doesn't contain path traversal
+void file_size_response(reply * out, message ** input, char * directory, m_node ** compressor) {
     char *filename = (char*) (*input)->buffer;
-    if (strstr(filename, "..") != NULL || strchr(filename, '/') != NULL) {
-        error_send(sockfd);
+    char * path = file_path(directory, filename);
+    if (path == NULL) {
+        error_send(out);
         return;
     }
-    
-    // Use snprintf to prevent buffer overflow
-    size_t path_len = strlen(directory) + strlen(filename) + 2;
-    char * path = malloc(path_len);
-    if (!path) {
-        error_send(sockfd);
-        return;
-    }
-    snprintf(path, path_len, "%s/%s", directory, filename);
-    
-    int fd = open(path, O_RDONLY);
-    if (fd == -1) {
+    // The directory index knows the size, or that the file does not exist, without a system call.
+    uint64_t size;
+    int known = dirindex_lookup(filename, &size);
+    if (known == 0) {
         free(path);
-        error_send(sockfd);
+        error_send(out);
         return;
     }
-    // Using the stat library calculate the file size.
-    struct stat st;
-    stat(path, &st);
-    uint64_t size = st.st_size;
-    close(fd);
+    if (known == -1) {
+        // The size comes from the cached stat of the file.
+        file_map * m = filecache_acquire(path);
+        if (m == NULL) {
+            free(path);
+            error_send(out);
+            return;
+        }
+        size = m->st.st_size;
+        filecache_release(m);
+    }
     free(path);
     char header;
     // Set the message header appropriately, but compress since bit set.
@@ -166,44 +288,22 @@ void file_size_response(int sockfd, message ** input, char * directory, m_node *
         memcpy(msg->buffer , &size, 8);
         // Send for compression.
         compress(&msg, compressor);
-        unsigned char * send_container = malloc(9 + msg->length);
-        // Stores the old_length, before endian swap.
-        uint64_t old_l = msg->length;
-        msg->length = bswap_64(msg->length);
-        // Set header appropriately.
-        send_container[0] = header;
-        // Copy contents of compressed across to the final container.
-        memcpy(send_container + 1, &msg->length, 8);
-        memcpy(send_container + 9, msg->buffer, old_l);
-        send(sockfd, send_container, 9 + old_l, 0);
-        free(msg->buffer);
+        reply_frame(out, header, msg->buffer, msg->length, 1);
         free(msg);
-        free(send_container);
-        
     }
     else {
         // Set the message header appropriately (depending on compression).
         header = 0b01010000;
-        uint64_t length = bswap_64(8);
-        unsigned char * send_container = malloc(17);
-        // Set header appropriately.
-        send_container[0] = header;
-        // Copy the contents of the message to be sent to the relevant container.
-        memcpy(send_container + 1, &length, 8);
-        size = bswap_64(size);
-        memcpy(send_container + 9, &size, 8);
-        send(sockfd, send_container, 17, 0);
-        free(send_container);
+        uint64_t * payload = malloc(8);
+        *payload = bswap_64(size);
+        reply_frame(out, header, payload, 8, 1);
     }
-    
-    free(path);
 }
 /*
-    Takes in the name of the directory and lists files in the directory.
-    Stores these in a dynamically allocated array of characters.
-    Uses DIR pointers as opposed to purely low level system calls.
+    List the regular files of directory into a new buffer of *length bytes, each name
+    followed by a null byte, or a single null byte when there are none.
 */
-void directory_send(int sockfd, message ** input, char * directory, m_node ** compressor) {
+unsigned char * directory_list(char * directory, uint64_t * length) {
     int old_l = 0;
     unsigned char * buf = NULL;
     struct dirent *de;
@@ -225,39 +325,42 @@ void directory_send(int sockfd, message ** input, char * directory, m_node ** co
             buf = realloc(buf, 1);
             buf[old_l - 1] = '\0';
         }
+        closedir(d);
     }
     else {
         printf("This broke\n");
     }
+    *length = old_l;
+    return buf;
+}
+/*
+    Takes in the name of the directory and lists files in the directory.
+    Stores these in a dynamically allocated array of characters.
+    Uses DIR pointers as opposed to purely low level system calls.
+*/
+void directory_send(reply * out, message ** input, char * directory, m_node ** compressor) {
+    // The directory index keeps the whole response ready, only read the directory when there is no index.
+    int compressed = (*input)->main.requires_compression == 1;
+    listing * l = dirindex_listing(compressed, compressor);
+    if (l != NULL) {
+        reply_shared(out, l->frame[compressed], l->length[compressed], dirindex_release, l);
+        return;
+    }
+    uint64_t old_l;
+    unsigned char * buf = directory_list(directory, &old_l);
 
-    char header;
     if ((*input)->main.requires_compression == 1) {
-        header = 0b00111000;
-        send(sockfd, &header, 1, 0);
         message * msg = malloc(sizeof(message));
         msg->buffer = buf;
         msg->length = old_l;
         // Compress data attached to standard message input.
         compress(&msg, compressor);
-        old_l = msg->length;
-        msg->length = bswap_64(msg->length);
-        // Send compressed directory data piecewise - length then buffer.
-        send(sockfd, &msg->length, 8, 0);
-        send(sockfd , msg->buffer, old_l, 0);
-        free(msg->buffer);
+        reply_frame(out, 0b00111000, msg->buffer, msg->length, 1);
         free(msg);
     }
     else {
-        header = 0b00110000;
-        send(sockfd, &header, 1, 0);
-        uint64_t temp = old_l;
-        temp = bswap_64(temp);
-        send(sockfd, &temp, 8, 0);
-        send(sockfd, buf, old_l, 0);
-        free(buf);
-    }
-    closedir(d);
-    
+        reply_frame(out, 0b00110000, buf, old_l, 1);
+    }
 }
 /*
     Accesses a message, dissects in terms of the file request description components and creates
@@ -265,6 +368,8 @@ void directory_send(int sockfd, message ** input, char * directory, m_node ** co
 */
 file_request * dissect_file_request(message * input) {
     file_request * req = malloc(sizeof(file_request));
+    // A request added to the list is its tail until another follows it.
+    req->next = NULL;
     memcpy(&req->session_id, input->buffer, 4);
     memcpy(&req->offset, (input->buffer + 4), 8);
     memcpy(&req->length, (input->buffer + 12), 8);
@@ -278,192 +383,290 @@ file_request * dissect_file_request(message * input) {
     return req;
 }
 
-void child_send(int sockfd, int compressed, char * directory, file_request ** input, m_node ** dict) {
-    // Validate filename doesn't contain path traversal
-    char *filename = (char *)(*input)->file_name;
-    if (strstr(filename, "..") != NULL || strchr(filename, '/') != NULL) {
-        error_send(sockfd);
-        return;
+/*
+    Read a range of a file into buf. Bytes past the end of a file
+    truncated underneath the server are sent as zeros.
+*/
+static void read_range(int fd, unsigned char * buf, uint64_t length, uint64_t offset) {
+    uint64_t done = 0;
+    while (done < length) {
+        ssize_t n = pread(fd, buf + done, length - done, offset + done);
+        if (n <= 0) {
+            memset(buf + done, 0, length - done);
+            return;
+        }
+        done += n;
     }
-    
-    // Use snprintf to prevent buffer overflow
-    size_t path_len = strlen(directory) + strlen(filename) + 2;
-    char * path = malloc(path_len);
-    if (!path) {
-        error_send(sockfd);
+}
+/*
+    The encoding of a segment's file bytes lives outside the stack frame,
+    so it is still intact after a SIGBUS jumps out of the encoder.
+*/
+static __thread encoder segment_encoder;
+/*
+    Encode the file bytes of a segment straight out of the shared mapping of its file.
+    Returns 0 if the mapping could not be used, in which case the encoder has been freed.
+*/
+static int segment_encode_mapped(encoder * e, file_map * m, uint64_t offset, uint64_t length,
+    m_node ** dict) {
+    const unsigned char * data = filecache_data(m);
+    if (data == NULL || offset + length > m->length) {
+        free(e->buffer);
+        return 0;
+    }
+    if (!encpool_encode(e, data + offset, length, dict)) {
+        // The file was truncated while being read, drop the partial encoding and the mapping.
+        free(e->buffer);
+        filecache_invalidate(m);
+        return 0;
+    }
+    return 1;
+}
+/*
+    Append the encoding of a segment's file bytes to e. The encoding is sliced from the
+    file's sidecar if it has one, or comes from the segment cache when this range of this
+    version of the file was encoded before, otherwise it is made from the mapping (or read,
+    if that fails) and cached.
+*/
+static void segment_encode(encoder * e, file_map * m, uint64_t offset, uint64_t length, m_node ** dict) {
+    // A sidecar written ahead of time holds the encoding already.
+    if (sidecar_splice(e, m, offset, length, dict)) {
         return;
     }
-    snprintf(path, path_len, "%s/%s", directory, filename);
-    // Pull offset and length from pipe contained in the file request.
-    uint64_t o_l[2];
-    read((*input)->pipefd[0], o_l, 16);
-    unsigned char * buffer = malloc(20 + o_l[1]);
-    uint32_t temp_int = bswap_32((*input)->session_id);
-    o_l[0] = bswap_64(o_l[0]);
-    o_l[1] = bswap_64(o_l[1]);
-    // Copy contents of file header to new buffer.
-    memcpy(buffer, &temp_int, 4);
-    memcpy(buffer + 4, &o_l[0], 8);
-    memcpy(buffer + 12, &o_l[1], 8);
-    o_l[0] = bswap_64(o_l[0]);
-    o_l[1] = bswap_64(o_l[1]);
-    int fd = open(path, O_RDONLY);
-    if (fd == -1) {
-        free(buffer);
-        free(path);
-        error_send(sockfd);
+    int build;
+    segment * s = segcache_acquire(&m->st, offset, length, dict_hash(dict), &build);
+    if (s != NULL && !build) {
+        encode_append(e, s->bits, 0, s->nbits);
+        segcache_release(s);
         return;
     }
-    // Seek to location in file.
-    lseek(fd, o_l[0], SEEK_SET);
-    // Read contents of file into buffer.
-    read(fd, buffer + 20, o_l[1]);
-    close(fd);
-    free(path);
+    encoder * d = &segment_encoder;
+    encode_start(d);
+    int mapped = segment_encode_mapped(d, m, offset, length, dict);
+    if (!mapped) {
+        // Fall back to reading the range.
+        encode_start(d);
+        unsigned char * data = malloc(length);
+        read_range(m->fd, data, length, offset);
+        encpool_encode(d, data, length, dict);
+        free(data);
+    }
+    encode_append(e, d->buffer, 0, d->bits);
+    if (s != NULL && mapped) {
+        segcache_publish(s, d->buffer, d->bits);
+    }
+    else {
+        // A range that could not be mapped may be from a file changing underneath, do not keep it.
+        if (s != NULL) {
+            segcache_abandon(s);
+        }
+        free(d->buffer);
+    }
+    if (s != NULL) {
+        segcache_release(s);
+    }
+}
+/*
+    Queue one file segment response. An uncompressed segment sends the frame and segment
+    headers with the responses queued before it, then streams the file bytes with sendfile.
+    A compressed segment encodes the segment header, then appends the encoding of the file bytes.
+*/
+static void segment_send(reply * out, int compressed, file_map * m, uint32_t session_id,
+    uint64_t offset, uint64_t length, m_node ** dict) {
     if (compressed == 1) {
-        message * msg = malloc(sizeof(message));
-        msg->buffer = buffer;
-        msg->length = 20 + o_l[1];
-        // Attach memory to standard message input and compress.
-        compress(&msg, dict);
-        // Store old length, before endian swap.
-        uint64_t temp = msg->length;
-        msg->length = bswap_64(msg->length);
-        // Create container for final message.
-        unsigned char * send_container = malloc(9 + temp);
-        send_container[0] = 0b01111000;
-        // Copy data to sending container.
-        memcpy(send_container + 1, &msg->length, 8);
-        memcpy(send_container + 9, msg->buffer, temp);
-        send(sockfd, send_container, temp + 9, 0);
-        // Cleanup.
-        free(msg->buffer);
-        free(msg);
-        free(send_container);
+        encoder e;
+        unsigned char head[20];
+        segment_header(head, session_id, offset, length);
+        encode_start(&e);
+        encode(&e, head, 20, dict);
+        segment_encode(&e, m, offset, length, dict);
+        encode_finish(&e);
+        reply_frame(out, 0b01111000, e.buffer, e.length, 1);
     }
     else {
-        uint64_t temp = 20 + o_l[1];
-        // Create container for final message.
-        unsigned char * send_container = malloc(9 + temp);
-        send_container[0] = 0b01110000;
-        uint64_t temp_o = bswap_64(temp);
-        // Copy data to container.
-        memcpy(send_container + 1, &temp_o, 8);
-        memcpy(send_container + 9, buffer, temp);
-        send(sockfd, send_container, temp + 9, 0);
-        free(send_container);
-        free(buffer);
+        segment_header(reply_head(out, 0b01110000, 20 + length, 20), session_id, offset, length);
+        reply_file(out, m->fd, offset, length);
     }
 }
 
-void parent_send(int sockfd, int compressed, char * directory, file_request ** input, m_node ** dict) {
-    // Validate filename doesn't contain path traversal
-    char *filename = (char *)((*input)->file_name);
-    if (strstr(filename, "..") != NULL || strchr(filename, '/') != NULL) {
-        error_send(sockfd);
+/*
+    Send a child's share of the range, once read from the parent's pipe.
+*/
+static void child_segment(reply * out, int compressed, char * path, uint32_t session_id,
+    uint64_t o_l[2], m_node ** dict) {
+    file_map * m = filecache_acquire(path);
+    if (m == NULL) {
+        error_send(out);
         return;
     }
-    
-    // Use snprintf to prevent buffer overflow
-    size_t path_len = strlen(directory) + strlen(filename) + 2;
-    char * path = malloc(path_len);
-    if (!path) {
-        error_send(sockfd);
+    segment_send(out, compressed, m, session_id, o_l[0], o_l[1], dict);
+    filecache_release(m);
+}
+/*
+    Send a child retrieval's share of the range, once the parent has written it to the
+    pipe. Called in a read section, which is left while waiting, and dict updated.
+*/
+void child_send(reply * out, int compressed, char * directory, file_request ** input, m_node ** dict) {
+    char * path = file_path(directory, (char *) (*input)->file_name);
+    if (path == NULL) {
+        error_send(out);
         return;
     }
-    snprintf(path, path_len, "%s/%s", directory, filename);
-
-    int fd = open(path, O_RDONLY);
-
+    // The parent may be waiting on earlier responses, send them before blocking.
+    reply_flush(out);
+    // Pull offset and length from pipe contained in the file request. The parent may
+    // take as long as its slowest client, so a reload is not held up meanwhile: the
+    // share is encoded with the dictionary current once it arrives.
+    uint64_t o_l[2];
+    dictionary_exit();
+    read((*input)->pipefd[0], o_l, 16);
+    *dict = dictionary_enter();
+    child_segment(out, compressed, path, (*input)->session_id, o_l, dict);
+    free(path);
+}
+/*
+    Set a child retrieval up to wait for its share of the range without blocking, on a
+    non-blocking duplicate of the parent's pipe, which outlives the file request.
+    Returns NULL, having queued an error, if it cannot wait.
+*/
+child_wait * child_park(connection * cl, int compressed, char * directory, file_request * input) {
+    char * path = file_path(directory, (char *) input->file_name);
+    int fd = path == NULL ? -1 : dup(input->pipefd[0]);
     if (fd == -1) {
         free(path);
-        error_send(sockfd);
-        return;
+        error_send(&cl->out);
+        return NULL;
     }
-    // Use stat library to measure file size.
-    struct stat st;
-    stat(path, &st);
+    // Every child of the request waits this way, so none relies on a blocking read.
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    // The parent may be waiting on earlier responses.
+    reply_flush(&cl->out);
+    child_wait * wait = malloc(sizeof(child_wait));
+    wait->fd = fd;
+    wait->compressed = compressed;
+    wait->session_id = input->session_id;
+    wait->path = path;
+    return wait;
+}
+/*
+    Stop a child retrieval waiting, closing its duplicate of the pipe.
+*/
+void child_unpark(connection * cl) {
+    if (cl->wait != NULL) {
+        close(cl->wait->fd);
+        free(cl->wait->path);
+        free(cl->wait);
+        cl->wait = NULL;
+    }
+}
+/*
+    Send a parked child's share of the range once the pipe is readable. Returns -1 while
+    another child took the share written, and 0 once the child has been answered.
+*/
+int child_resume(connection * cl, m_node ** dict) {
+    uint64_t o_l[2];
+    ssize_t n = read(cl->wait->fd, o_l, 16);
+    if (n == -1 && (errno == EAGAIN || errno == EINTR)) {
+        return -1;
+    }
+    if (n != 16) {
+        // The parent finished without a share for this child.
+        error_send(&cl->out);
+        return 0;
+    }
+    child_segment(&cl->out, cl->wait->compressed, cl->wait->path, cl->wait->session_id, o_l, dict);
+    return 0;
+}
 
-    if ((*input)->offset > st.st_size || (*input)->offset + (*input)->length > st.st_size) {
-        close(fd);
+void parent_send(reply * out, int compressed, char * directory, file_request ** input, m_node ** dict) {
+    char *filename = (char *)((*input)->file_name);
+    char * path = file_path(directory, filename);
+    if (path == NULL) {
+        error_send(out);
+        return;
+    }
+    // Names the directory index does not hold are turned away without a system call.
+    uint64_t size;
+    if (dirindex_lookup(filename, &size) == 0) {
         free(path);
-        error_send(sockfd);
+        error_send(out);
+        return;
+    }
+    file_map * m = filecache_acquire(path);
+    free(path);
+    if (m == NULL) {
+        error_send(out);
+        return;
+    }
+    // Check the range against the cached stat of the file.
+    uint64_t file_size = m->st.st_size;
+    if ((*input)->offset > file_size || (*input)->offset + (*input)->length > file_size) {
+        filecache_release(m);
+        error_send(out);
         return;
     }
-    uint64_t size = (*input)->length;
-    /* Divide the file size into blocks, depending on the number
-    of connections. */
-    uint64_t division = 0;
-    division = size / ((*input)->num_connect + 1);
-    // Initialise a buffer with the basic file segment details.
-    unsigned char * buffer = malloc(20 + division);
-    division = bswap_64(division);
-    (*input)->session_id = bswap_32((*input)->session_id);
-    memcpy(buffer, &((*input)->session_id), 4);
-    memcpy(buffer + 12, &division, 8);
-    division = bswap_64(division);
-    (*input)->session_id = bswap_32((*input)->session_id);
+    // Take the parent's share of the range, and hand the rest to the children.
+    uint64_t current_offset = 0;
+    uint64_t division = split_request(*input, &current_offset);
+    segment_send(out, compressed, m, (*input)->session_id, current_offset, division, dict);
+    filecache_release(m);
+}
+/*
+    Divide the requested range into blocks, depending on the number of connections.
+    Writes the offset and length of each multiplexed connection's block to the pipe,
+    and returns the length of the parent's block, storing its offset in offset.
+*/
+uint64_t split_request(file_request * input, uint64_t * offset) {
+    uint64_t size = input->length;
+    uint64_t division = size / (input->num_connect + 1);
     // Set the current offset to the offset specified in the message header.
-    uint64_t current_offset = (*input)->offset;
+    uint64_t current_offset = input->offset;
     // Split the remaining data into new segments.
-    if ((*input)->num_connect > 0) {
+    if (input->num_connect > 0) {
         // Write the next offset and length to the pipe to each multiplexed connection.
         uint64_t o_l[2];
         uint64_t num_alt = division + 1;
         o_l[0] = current_offset;
         o_l[1] = num_alt;
-        for(int i = 0; i <  size % ((*input)->num_connect + 1); i++) {
-            write((*input)->pipefd[1], o_l, 16);
+        for (uint64_t i = 0; i < size % (input->num_connect + 1); i++) {
+            write(input->pipefd[1], o_l, 16);
             current_offset+=num_alt;
             o_l[0] = current_offset;
         }
-        int remaining = (*input)->num_connect - (size % ((*input)->num_connect + 1));
+        int remaining = input->num_connect - (size % (input->num_connect + 1));
         o_l[1] = division;
         for (int i = 0; i < remaining; i++) {
-            write((*input)->pipefd[1], o_l, 16);
+            write(input->pipefd[1], o_l, 16);
             current_offset+=division;
             o_l[0] = current_offset;
         }
     }
-    // Add offset for the parent sender to the buffer.
-    current_offset = bswap_64(current_offset);
-    memcpy(buffer + 4, &current_offset, 8);
-    current_offset = bswap_64(current_offset);
-    // Seek to the offset.
-    lseek(fd, current_offset, SEEK_SET);
-    read(fd, buffer + 20, division);
-    
-    if (compressed == 1) {
-        message * msg = malloc(sizeof(message));
-        msg->buffer = buffer;
-        msg->length = division + 20;
-        // After putting compression data in standard form, compress.
-        compress(&msg, dict);
-        uint64_t temp = msg->length;
-        msg->length = bswap_64(msg->length);
-        // Configure container for final send with relevant file data.
-        unsigned char *send_container = malloc(9 + temp);
-        send_container[0] = 0b01111000;
-        memcpy(send_container + 1, &msg->length, 8);
-        memcpy(send_container + 9, msg->buffer, temp);
-        send(sockfd, send_container, temp + 9, 0);    
-        free(send_container);   
-        free(msg->buffer);
-        free(msg);
+    *offset = current_offset;
+    return division;
+}
+/*
+    Write the 20 byte file segment header (session, offset, length) in network byte order.
+*/
+void segment_header(unsigned char * out, uint32_t session_id, uint64_t offset, uint64_t length) {
+    session_id = bswap_32(session_id);
+    offset = bswap_64(offset);
+    length = bswap_64(length);
+    memcpy(out, &session_id, 4);
+    memcpy(out + 4, &offset, 8);
+    memcpy(out + 12, &length, 8);
+}
+/*
+    Build the path of a file in the served directory. Returns NULL when the
+    name would escape the directory (path traversal), or allocation fails.
+*/
+char * file_path(char * directory, char * filename) {
+    if (strstr(filename, "..") != NULL || strchr(filename, '/') != NULL) {
+        return NULL;
     }
-    else {
-        uint64_t temp = division + 20;
-        uint64_t o_temp = bswap_64(temp);
-        // Configure container for final send with relevant file data.
-        unsigned char *send_container = malloc(temp + 9);
-        send_container[0] = 0b01110000;
-        memcpy(send_container + 1, &o_temp, 8);
-        memcpy(send_container + 9, buffer, temp);
-        send(sockfd, send_container, 9 + temp, 0);
-        free(send_container);
-        free(buffer);
-    }
-    // Final cleanup.
-    free(path);
-    close(fd);
+    size_t path_len = strlen(directory) + strlen(filename) + 2;
+    char * path = malloc(path_len);
+    if (path) {
+        snprintf(path, path_len, "%s/%s", directory, filename);
+    }
+    return path;
 }
\ No newline at end of file
@@ -23,12 +23,22 @@ typedef struct message {
     unsigned char * buffer;
 } message;
 void get_config (char * file_name, struct sockaddr_in * main,  char ** directory);
-message * get_description(int sockfd, m_node ** compress);
-void error_send(int sockfd);
-void echo(int sockfd, message * input, m_node ** compress);
-void file_size_response(int sockfd, message ** input, char * directory, m_node ** compress);
-void directory_send(int sockfd, message ** input, char * directory, m_node ** compress);
+connection * connection_create(int sockfd);
+void connection_close(connection * cl);
+int get_description(connection * cl, message ** out, int flags);
+void decode_payload(message * msg, m_node ** compress);
+void error_send(reply * out);
+void echo(reply * out, message * input, m_node ** compress);
+void file_size_response(reply * out, message ** input, char * directory, m_node ** compress);
+unsigned char * directory_list(char * directory, uint64_t * length);
+void directory_send(reply * out, message ** input, char * directory, m_node ** compress);
 file_request * dissect_file_request(message * input);
-void child_send(int sockfd, int compressed, char * directory, file_request ** input, m_node ** dict);
-void parent_send(int sockfd, int compressed, char * directory, file_request ** input, m_node ** dict);
+void child_send(reply * out, int compressed, char * directory, file_request ** input, m_node ** dict);
+child_wait * child_park(connection * cl, int compressed, char * directory, file_request * input);
+int child_resume(connection * cl, m_node ** dict);
+void child_unpark(connection * cl);
+void parent_send(reply * out, int compressed, char * directory, file_request ** input, m_node ** dict);
+uint64_t split_request(file_request * input, uint64_t * offset);
+char * file_path(char * directory, char * filename);
+void segment_header(unsigned char * out, uint32_t session_id, uint64_t offset, uint64_t length);
 #endif
\ No newline at end of file
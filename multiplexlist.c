@@ -30,29 +30,21 @@ void add(List ** list, file_request * input) {
     pthread_mutex_unlock(&(*list)->lock);
 }
 /*
-    Remove node from linked list.
+    Remove node from linked list, wherever it is in the list.
 */
 void remove_node(List ** list, file_request * input) {
     pthread_mutex_lock(&(*list)->lock);
-    if (input == (*list)->head && input == (*list)->tail) {
-        free(input->file_name);
-        free(input);
-        (*list)->head = NULL;
-        (*list)->tail = NULL;
-        pthread_mutex_unlock(&(*list)->lock);
-        return;
+    file_request * prev = NULL;
+    file_request ** node = &(*list)->head;
+    while (*node != NULL && *node != input) {
+        prev = *node;
+        node = &(*node)->next;
     }
-    file_request * node = (*list)->head;
-    if ((*list)->head == NULL) {
-        pthread_mutex_unlock(&(*list)->lock);
-        return;
-    }
-    while (node->next != input) {
-        node = node->next;
-    }
-    node->next = input->next;
-    if ((*list)->tail == input) {
-        (*list)->tail = node;
+    if (*node == input) {
+        *node = input->next;
+        if ((*list)->tail == input) {
+            (*list)->tail = prev;
+        }
     }
     pthread_mutex_unlock(&(*list)->lock);
     free(input->file_name);
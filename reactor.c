@@ -0,0 +1,315 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include "reactor.h"
+#include "tp.h"
+#include "message_handling.h"
+#include "dictionary.h"
+
+#define REACTOR_EVENTS 64
+/*
+    Events armed for every client socket. Edge triggered and one shot, so a socket
+    is handed to exactly one worker per readiness edge and stays silent until rearmed.
+*/
+#define REACTOR_FLAGS (EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT)
+/*
+    Tag in the low bit of a shard's registration of a parked child's pipe, which holds
+    the connection (malloc'd, so aligned) like the registration of its socket.
+*/
+#define SHARD_PIPE 1
+
+static void * reactor_loop(void * args);
+/*
+    Handle messages until the client's socket has no more bytes waiting. Returns -1 once
+    it has, 0 once the socket has been closed and cl freed or the server has been shut,
+    and MESSAGE_PARKED once a child retrieval is waiting on its parent.
+*/
+static int serve_pending(connection * cl, thread_pool * tp) {
+    int status;
+    do {
+        if (tp->shut == 1) {
+            return 0;
+        }
+        // The socket is closed and cl freed when the client hangs up.
+        status = process_message(cl, tp);
+    } while (status == 1);
+    return status;
+}
+/*
+    Create the epoll instance and the reactor thread. The wake descriptor is registered
+    with a NULL pointer, and is used to pull the reactor out of epoll_wait on shutdown.
+*/
+int reactor_create(thread_pool * tp) {
+    tp->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (tp->epfd == -1) {
+        perror("epoll_create1 failed");
+        return -1;
+    }
+    tp->wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (tp->wakefd == -1) {
+        perror("eventfd failed");
+        close(tp->epfd);
+        return -1;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(tp->epfd, EPOLL_CTL_ADD, tp->wakefd, &ev);
+    if (pthread_create(&tp->reactor, NULL, reactor_loop, tp) != 0) {
+        perror("pthread_create failed");
+        close(tp->wakefd);
+        close(tp->epfd);
+        return -1;
+    }
+    return 0;
+}
+/*
+    Register a freshly accepted client with the reactor. No worker touches the
+    socket until the kernel reports it readable.
+*/
+void reactor_add(connection * cl, thread_pool * tp) {
+    struct epoll_event ev;
+    ev.events = REACTOR_FLAGS;
+    ev.data.ptr = cl;
+    if (epoll_ctl(tp->epfd, EPOLL_CTL_ADD, cl->fd, &ev) == -1) {
+        perror("epoll_ctl failed");
+        connection_close(cl);
+    }
+}
+/*
+    Wake the reactor thread so it notices the pool has been shut.
+*/
+void reactor_wake(thread_pool * tp) {
+    uint64_t one = 1;
+    write(tp->wakefd, &one, 8);
+}
+/*
+    Reactor thread loop. Waits for readiness and passes ready sockets to the
+    thread pool queue, so idle connections never hold a worker.
+*/
+static void * reactor_loop(void * args) {
+    thread_pool * tp = (thread_pool *) args;
+    struct epoll_event events[REACTOR_EVENTS];
+    while (1) {
+        int n = epoll_wait(tp->epfd, events, REACTOR_EVENTS, -1);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait failed");
+            return NULL;
+        }
+        if (tp->shut == 1) {
+            return NULL;
+        }
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr != NULL) {
+                enqueue((connection *) events[i].data.ptr, tp);
+            }
+        }
+    }
+    return NULL;
+}
+/*
+    Serve a readable client. Handles one message, and queues the client as a continuation
+    on this worker, so a pipelining client cannot hold it while other ready clients wait.
+    Once the socket runs dry, rearms the one shot registration, and any partly received
+    frame stays in the client's parser until the next readiness event.
+*/
+void reactor_serve(connection * cl, thread_pool * tp) {
+    if (tp->shut == 1) {
+        return;
+    }
+    int status = process_message(cl, tp);
+    if (status == 0) {
+        return;
+    }
+    if (status == 1) {
+        push_local(cl, tp);
+        return;
+    }
+    /*
+        Rearming re-evaluates readiness, so bytes arriving between the
+        failed receive and this call still produce an event.
+    */
+    struct epoll_event ev;
+    ev.events = REACTOR_FLAGS;
+    ev.data.ptr = cl;
+    if (epoll_ctl(tp->epfd, EPOLL_CTL_MOD, cl->fd, &ev) == -1) {
+        connection_close(cl);
+    }
+}
+/*
+    Create the wake descriptor shared by the shards, written once on shutdown
+    to pull every shard out of epoll_wait.
+*/
+int shard_create(thread_pool * tp) {
+    tp->wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (tp->wakefd == -1) {
+        perror("eventfd failed");
+        return -1;
+    }
+    return 0;
+}
+/*
+    Open this shard's own listening socket on the server address. SO_REUSEPORT lets every
+    shard bind the same port, and the kernel spreads incoming connections across them.
+*/
+static int shard_listen(thread_pool * tp) {
+    int sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd == -1) {
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1 ||
+        bind(sockfd, (struct sockaddr *) &tp->addr, sizeof(struct sockaddr_in)) == -1 ||
+        listen(sockfd, 500) == -1) {
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+/*
+    The events a shard client waits for: room to send while responses are queued,
+    otherwise more bytes, or only a hang up while parked.
+*/
+static uint32_t shard_events(connection * cl) {
+    if (reply_pending(&cl->out)) {
+        return EPOLLOUT;
+    }
+    return cl->wait != NULL ? EPOLLRDHUP : EPOLLIN | EPOLLRDHUP;
+}
+/*
+    Drop a shard client, and its pipe registration if it is parked.
+*/
+static void shard_drop(connection * cl, int epfd) {
+    if (cl->wait != NULL) {
+        // Closing a duplicate does not remove it while the pipe is open elsewhere.
+        epoll_ctl(epfd, EPOLL_CTL_DEL, cl->wait->fd, NULL);
+    }
+    connection_close(cl);
+}
+/*
+    Serve a client of a shard on an event of its socket, or of its pipe if from_pipe.
+    The socket is non-blocking, so responses it has no room for stay queued until it
+    reports room, and the client is not read from meanwhile. A child retrieval is parked
+    on its pipe until the parent writes its share of the range, and is then answered and
+    closed, so the shard never blocks on one client. Returns 1 once cl has been freed.
+*/
+static int shard_serve(connection * cl, thread_pool * tp, int epfd, uint32_t events, int from_pipe) {
+    uint32_t armed = shard_events(cl);
+    if (cl->wait != NULL && !from_pipe && (events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP))) {
+        // The client hung up while waiting on its parent.
+        shard_drop(cl, epfd);
+        return 1;
+    }
+    if (cl->wait != NULL && from_pipe) {
+        m_node * dict = dictionary_enter();
+        int status = child_resume(cl, &dict);
+        dictionary_exit();
+        if (status == -1) {
+            return 0;
+        }
+        epoll_ctl(epfd, EPOLL_CTL_DEL, cl->wait->fd, NULL);
+        child_unpark(cl);
+        cl->closing = 1;
+    }
+    int status = reply_pending(&cl->out) ? reply_flush(&cl->out) : 0;
+    if (status == -1 || (status == 0 && cl->closing)) {
+        shard_drop(cl, epfd);
+        return 1;
+    }
+    if (status == 0 && cl->wait == NULL) {
+        status = serve_pending(cl, tp);
+        if (status == 0) {
+            return 1;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = (uintptr_t) cl | SHARD_PIPE;
+        if (status == MESSAGE_PARKED && epoll_ctl(epfd, EPOLL_CTL_ADD, cl->wait->fd, &ev) == -1) {
+            connection_close(cl);
+            return 1;
+        }
+    }
+    if (shard_events(cl) != armed) {
+        struct epoll_event ev;
+        ev.events = shard_events(cl);
+        ev.data.ptr = cl;
+        if (epoll_ctl(epfd, EPOLL_CTL_MOD, cl->fd, &ev) == -1) {
+            shard_drop(cl, epfd);
+            return 1;
+        }
+    }
+    return 0;
+}
+/*
+    Worker loop in reuseport mode. Each shard owns a listening socket, its accept queue
+    and an epoll instance for the clients it accepted, so connections never pass through
+    the pool's deques.
+*/
+void * reactor_shard(void * args) {
+    thread_pool * tp = (thread_pool *) args;
+    int id = __atomic_fetch_add(&tp->started, 1, __ATOMIC_RELAXED);
+    int listener = shard_listen(tp);
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (listener == -1 || epfd == -1) {
+        perror("Failed to open shard listener");
+        exit(1);
+    }
+    tp->listeners[id] = listener;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tp->wakefd, &ev);
+    ev.data.ptr = &tp->listeners[id];
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listener, &ev);
+    struct epoll_event events[REACTOR_EVENTS];
+    while (tp->shut == 0) {
+        int n = epoll_wait(epfd, events, REACTOR_EVENTS, -1);
+        for (int i = 0; i < n && tp->shut == 0; i++) {
+            if (events[i].data.ptr == NULL) {
+                continue;
+            }
+            if (events[i].data.ptr != &tp->listeners[id]) {
+                uint64_t tag = events[i].data.u64;
+                connection * cl = (connection *) (uintptr_t) (tag & ~(uint64_t) SHARD_PIPE);
+                if (shard_serve(cl, tp, epfd, events[i].events, tag & SHARD_PIPE)) {
+                    // Later events of this batch for the freed client are dropped.
+                    for (int j = i + 1; j < n; j++) {
+                        if ((events[j].data.u64 & ~(uint64_t) SHARD_PIPE) == (uintptr_t) cl) {
+                            events[j].data.ptr = NULL;
+                        }
+                    }
+                }
+                continue;
+            }
+            // Drain this shard's accept queue.
+            int clfd;
+            while ((clfd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+                connection * cl = connection_create(clfd);
+                if (cl == NULL) {
+                    close(clfd);
+                    continue;
+                }
+                cl->out.nonblock = 1;
+                ev.events = shard_events(cl);
+                ev.data.ptr = cl;
+                if (epoll_ctl(epfd, EPOLL_CTL_ADD, clfd, &ev) == -1) {
+                    connection_close(cl);
+                }
+            }
+        }
+    }
+    close(epfd);
+    close(listener);
+    return NULL;
+}
\ No newline at end of file
@@ -0,0 +1,10 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+#include "tp.h"
+int reactor_create(thread_pool * tp);
+void reactor_add(connection * cl, thread_pool * tp);
+void reactor_serve(connection * cl, thread_pool * tp);
+void reactor_wake(thread_pool * tp);
+int shard_create(thread_pool * tp);
+void * reactor_shard(void * args);
+#endif
\ No newline at end of file
@@ -0,0 +1,444 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include "reply.h"
+#include "byteswap_compat.h"
+
+/*
+    Owned buffers at least this large are sent with MSG_ZEROCOPY, 0 turns it off.
+    The counters record completed zero copy sends, and those the kernel copied anyway.
+*/
+size_t reply_zerocopy_min = REPLY_ZEROCOPY;
+unsigned long reply_zerocopy_sent = 0;
+unsigned long reply_zerocopy_copied = 0;
+/*
+    Start an empty batch of responses for a socket.
+*/
+void reply_init(reply * out, int fd) {
+    out->fd = fd;
+    out->nonblock = 0;
+    out->count = 0;
+    out->nheads = 0;
+    out->bytes = 0;
+    out->zerocopy = 0;
+    out->zc_next = 0;
+    out->zc_done = 0;
+    out->nheld = 0;
+    out->zc_open = 0;
+    out->file_fd = -1;
+    out->file_left = 0;
+}
+/*
+    Queue an entry, handing ref to release (or to free, without one) once it is sent.
+    The batch is written out once it is full.
+*/
+static void queue(reply * out, void * data, size_t length, void * ref, void (* release)(void *)) {
+    if (out->count == REPLY_IOV) {
+        reply_flush(out);
+    }
+    out->iov[out->count].iov_base = data;
+    out->iov[out->count].iov_len = length;
+    out->owned[out->count] = ref;
+    out->release[out->count] = release;
+    out->count++;
+    out->bytes += length;
+    if (out->bytes >= REPLY_BATCH) {
+        reply_flush(out);
+    }
+}
+/*
+    Queue a buffer to be sent after everything queued before it. An owned buffer
+    is freed once sent.
+*/
+void reply_add(reply * out, void * data, size_t length, int owned) {
+    queue(out, data, length, owned ? data : NULL, NULL);
+}
+/*
+    Queue a buffer shared with other connections, such as a cached response. It is
+    sent like any other, and release is called with ref once it has been.
+*/
+void reply_shared(reply * out, void * data, size_t length, void (* release)(void *), void * ref) {
+    queue(out, data, length, ref, release);
+}
+/*
+    Queue a frame header: the header byte and the length in network byte order,
+    followed by extra bytes (at most 20) that the caller fills in through the
+    returned pointer. Room is left for the payload to follow in the same batch.
+*/
+unsigned char * reply_head(reply * out, unsigned char header, uint64_t length, size_t extra) {
+    if (out->count > REPLY_IOV - 2) {
+        reply_flush(out);
+    }
+    unsigned char * head = out->heads[out->nheads++];
+    uint64_t net = bswap_64(length);
+    head[0] = header;
+    memcpy(head + 1, &net, 8);
+    // Not sent until the payload is added, so the caller can fill in the extra bytes.
+    out->iov[out->count].iov_base = head;
+    out->iov[out->count].iov_len = 9 + extra;
+    out->owned[out->count] = NULL;
+    out->release[out->count] = NULL;
+    out->count++;
+    out->bytes += 9 + extra;
+    return head + 9;
+}
+/*
+    Queue a whole response: the frame header, then the payload, which is
+    referenced rather than copied.
+*/
+void reply_frame(reply * out, unsigned char header, void * payload, uint64_t length, int owned) {
+    reply_head(out, header, length, 0);
+    if (length > 0) {
+        reply_add(out, payload, length, owned);
+    }
+    else if (owned) {
+        free(payload);
+    }
+}
+/*
+    Whether a send failed only because a non-blocking socket is full.
+*/
+static int would_block(reply * out) {
+    return out->nonblock && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+/*
+    Send a run of entries with as few sendmsg calls as the socket allows. Each call made
+    with MSG_ZEROCOPY in flags takes the next zero copy sequence number. Entries are
+    emptied as they are sent, and one sent part way is left pointing at the rest.
+    Returns -1 if the client has gone, or the kernel refused a zero copy send,
+    and 1 if a non-blocking socket filled up first.
+*/
+static int send_iov(reply * out, struct iovec * iov, int count, int flags) {
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = iov;
+    mh.msg_iovlen = count;
+    while (mh.msg_iovlen > 0) {
+        ssize_t n = sendmsg(out->fd, &mh, MSG_NOSIGNAL | flags);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && would_block(out)) {
+            return 1;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        if (flags & MSG_ZEROCOPY) {
+            out->zc_next++;
+        }
+        // Step over what was sent, resuming part way through an entry if needed.
+        while (mh.msg_iovlen > 0 && (size_t) n >= mh.msg_iov->iov_len) {
+            n -= mh.msg_iov->iov_len;
+            mh.msg_iov->iov_len = 0;
+            mh.msg_iov++;
+            mh.msg_iovlen--;
+        }
+        if (mh.msg_iovlen > 0) {
+            mh.msg_iov->iov_base = (char *) mh.msg_iov->iov_base + n;
+            mh.msg_iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+/*
+    Move the owned buffer of entry i to held, until the last zero copy send so far completes.
+*/
+static void hold(reply * out, int i) {
+    out->held[out->nheld] = out->owned[i];
+    out->held_seq[out->nheld] = out->zc_next - 1;
+    out->nheld++;
+    out->owned[i] = NULL;
+    out->zc_open = 0;
+}
+/*
+    Send one large owned entry with MSG_ZEROCOPY, and hold its buffer until the kernel
+    is done with the pages. Falls back to a copying send where the socket or the kernel
+    refuses zero copy. An entry a non-blocking socket took only part of is held once
+    the rest has gone too, so the buffer outlives every send made from it.
+*/
+static int send_zerocopy(reply * out, int i, int flags) {
+    if (out->zerocopy == 0) {
+        int one = 1;
+        out->zerocopy = setsockopt(out->fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0 ? 1 : -1;
+    }
+    if (out->zerocopy == 1 && !out->nonblock) {
+        // Wait for room to hold the buffer.
+        while (out->nheld == REPLY_HELD) {
+            struct pollfd pfd = {out->fd, 0, 0};
+            if (poll(&pfd, 1, 1000) <= 0) {
+                break;
+            }
+            reply_reap(out);
+        }
+    }
+    int status = -1;
+    errno = ENOBUFS;
+    // An open entry always has room, as nothing has been held since its first send.
+    if (out->zerocopy == 1 && out->nheld < REPLY_HELD) {
+        struct iovec iov = out->iov[i];
+        uint32_t first = out->zc_next;
+        status = send_iov(out, &iov, 1, flags | MSG_ZEROCOPY);
+        out->zc_open |= out->zc_next != first;
+        out->iov[i] = iov;
+    }
+    if (status == -1 && errno == ENOBUFS) {
+        // Out of option memory for zero copy, the rest is copied.
+        __atomic_fetch_add(&reply_zerocopy_copied, 1, __ATOMIC_RELAXED);
+        status = send_iov(out, &out->iov[i], 1, flags);
+    }
+    if (status != 1 && out->zc_open) {
+        hold(out, i);
+    }
+    return status;
+}
+/*
+    Free the owned buffers of every queued entry, sent or dropped, and empty the batch.
+*/
+static void release_batch(reply * out) {
+    if (out->zc_open) {
+        // The kernel may still be reading the part sent.
+        hold(out, 0);
+    }
+    for (int i = 0; i < out->count; i++) {
+        if (out->release[i] != NULL) {
+            out->release[i](out->owned[i]);
+        }
+        else {
+            free(out->owned[i]);
+        }
+    }
+    out->count = 0;
+    out->nheads = 0;
+    out->bytes = 0;
+}
+/*
+    Release the entries a non-blocking socket took, and move those it did not to the
+    front, with their frame headers, so the batch carries on from where it stopped.
+*/
+static void keep_unsent(reply * out) {
+    int sent = 0;
+    while (sent < out->count && out->iov[sent].iov_len == 0) {
+        if (out->release[sent] != NULL) {
+            out->release[sent](out->owned[sent]);
+        }
+        else {
+            free(out->owned[sent]);
+        }
+        sent++;
+    }
+    int heads = 0;
+    out->bytes = 0;
+    for (int i = sent; i < out->count; i++) {
+        unsigned char * base = out->iov[i].iov_base;
+        if (base >= out->heads[0] && base < out->heads[REPLY_IOV]) {
+            // Headers only move down, so none is overwritten before it has moved.
+            memmove(out->heads[heads], base, out->iov[i].iov_len);
+            base = out->heads[heads++];
+        }
+        out->iov[i - sent].iov_base = base;
+        out->iov[i - sent].iov_len = out->iov[i].iov_len;
+        out->owned[i - sent] = out->owned[i];
+        out->release[i - sent] = out->release[i];
+        out->bytes += out->iov[i].iov_len;
+    }
+    out->count -= sent;
+    out->nheads = heads;
+}
+/*
+    Close the descriptor kept for a file range, once it has gone or been dropped.
+*/
+static void file_done(reply * out) {
+    if (out->file_fd != -1) {
+        close(out->file_fd);
+        out->file_fd = -1;
+    }
+    out->file_left = 0;
+}
+/*
+    Send the file range from file_pos with sendfile, from the page cache with no user
+    space buffer. Bytes past the end of a file truncated underneath the server are sent
+    as zeros. A non-blocking socket that fills up keeps the rest of the range, on a
+    duplicate of fd that outlives the caller's. Returns -1 if the client has gone,
+    and 1 if some of the range is left.
+*/
+static int send_file(reply * out, int fd) {
+    int status = 0;
+    while (out->file_left > 0) {
+        size_t chunk = out->file_left > REPLY_SENDFILE ? REPLY_SENDFILE : out->file_left;
+        ssize_t n = sendfile(out->fd, fd, &out->file_pos, chunk);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0) {
+            static const char zeros[4096];
+            n = send(out->fd, zeros, chunk > sizeof(zeros) ? sizeof(zeros) : chunk, MSG_NOSIGNAL);
+            out->file_pos += n > 0 ? n : 0;
+        }
+        if (n == -1 && would_block(out)) {
+            if (out->file_fd == -1) {
+                out->file_fd = dup(fd);
+            }
+            if (out->file_fd != -1) {
+                return 1;
+            }
+        }
+        if (n <= 0) {
+            status = -1;
+            break;
+        }
+        out->file_left -= n;
+    }
+    file_done(out);
+    return status;
+}
+/*
+    Write out every queued response, then free the owned buffers. Runs of small entries
+    go out with one sendmsg each, and large owned buffers go out on their own with
+    MSG_ZEROCOPY. MSG_MORE in flags tells the kernel more bytes follow straight after.
+    A file range left over goes out after them, as nothing is queued behind one.
+    Returns -1 if the client has gone, in which case the batch is dropped, and 1 if
+    a non-blocking socket filled up, in which case the rest stays queued.
+*/
+static int send_batch(reply * out, int flags) {
+    int status = 0;
+    int start = 0;
+    if (out->file_left > 0) {
+        flags |= MSG_MORE;
+    }
+    for (int i = 0; i <= out->count && status == 0; i++) {
+        int zc = i < out->count && ((i == 0 && out->zc_open) || (reply_zerocopy_min > 0 &&
+            out->zerocopy != -1 && out->owned[i] != NULL && out->release[i] == NULL &&
+            out->iov[i].iov_len >= reply_zerocopy_min));
+        if (i < out->count && !zc) {
+            continue;
+        }
+        if (i > start) {
+            status = send_iov(out, &out->iov[start], i - start, i < out->count ? MSG_MORE : flags);
+        }
+        if (zc && status == 0) {
+            status = send_zerocopy(out, i, i + 1 < out->count ? MSG_MORE : flags);
+        }
+        start = i + 1;
+    }
+    if (status == 0 && out->file_left > 0) {
+        status = send_file(out, out->file_fd);
+    }
+    if (status == 1) {
+        keep_unsent(out);
+    }
+    else {
+        release_batch(out);
+        file_done(out);
+    }
+    if (out->nheld > 0) {
+        reply_reap(out);
+    }
+    return status;
+}
+/*
+    Read zero copy completions from the socket's error queue without blocking, count
+    whether the kernel really avoided the copy, and free the buffers they release.
+    TCP reports completions as ranges of sequence numbers, in order.
+*/
+void reply_reap(reply * out) {
+    char control[128];
+    struct msghdr mh;
+    while (1) {
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+        if (recvmsg(out->fd, &mh, MSG_ERRQUEUE) == -1) {
+            break;
+        }
+        for (struct cmsghdr * cm = CMSG_FIRSTHDR(&mh); cm != NULL; cm = CMSG_NXTHDR(&mh, cm)) {
+            struct sock_extended_err * ee = (struct sock_extended_err *) CMSG_DATA(cm);
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) ||
+                ee->ee_errno != 0 || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            unsigned long sends = ee->ee_data - ee->ee_info + 1;
+            if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                __atomic_fetch_add(&reply_zerocopy_copied, sends, __ATOMIC_RELAXED);
+            }
+            else {
+                __atomic_fetch_add(&reply_zerocopy_sent, sends, __ATOMIC_RELAXED);
+            }
+            out->zc_done = ee->ee_data + 1;
+        }
+    }
+    // Free the held buffers whose last send has completed.
+    int done = 0;
+    while (done < out->nheld && (int32_t) (out->held_seq[done] - out->zc_done) < 0) {
+        free(out->held[done]);
+        done++;
+    }
+    memmove(out->held, out->held + done, (out->nheld - done) * sizeof(void *));
+    memmove(out->held_seq, out->held_seq + done, (out->nheld - done) * sizeof(uint32_t));
+    out->nheld -= done;
+}
+/*
+    Write out every queued response, and wait (for a few seconds at most) for the kernel
+    to finish with any zero copy buffers before the socket is closed. Whatever a
+    non-blocking socket has no room for is dropped.
+*/
+void reply_close(reply * out) {
+    if (send_batch(out, 0) == 1) {
+        release_batch(out);
+        file_done(out);
+    }
+    for (int waits = 0; out->nheld > 0 && waits < 30; waits++) {
+        struct pollfd pfd = {out->fd, 0, 0};
+        poll(&pfd, 1, 100);
+        reply_reap(out);
+    }
+    for (int i = 0; i < out->nheld; i++) {
+        free(out->held[i]);
+    }
+    out->nheld = 0;
+}
+/*
+    Write out every queued response. Returns -1 if the client has gone, and 1 if a
+    non-blocking socket filled up with some of them still queued.
+*/
+int reply_flush(reply * out) {
+    return send_batch(out, 0);
+}
+/*
+    Whether responses are queued but not yet sent, such as those a non-blocking socket
+    had no room for.
+*/
+int reply_pending(reply * out) {
+    return out->count > 0 || out->file_left > 0;
+}
+/*
+    Send length bytes of a file from offset, after everything queued so far. The queued
+    responses go out with MSG_MORE so they share segments with the first file bytes, and
+    the file is sent from the page cache with sendfile, with no user space buffer.
+    Returns -1 if the client has gone, and 1 if a non-blocking socket filled up, in which
+    case what is left of the range goes out with the next flush.
+*/
+int reply_file(reply * out, int fd, uint64_t offset, uint64_t length) {
+    int status = send_batch(out, length > 0 ? MSG_MORE : 0);
+    if (status == -1 || length == 0) {
+        return status;
+    }
+    out->file_pos = offset;
+    out->file_left = length;
+    if (status == 1) {
+        out->file_fd = dup(fd);
+        if (out->file_fd == -1) {
+            out->file_left = 0;
+            return -1;
+        }
+        return 1;
+    }
+    return send_file(out, fd);
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#ifndef REPLY_H
+#define REPLY_H
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+// Entries a batch holds before it is written out.
+#define REPLY_IOV 64
+// Bytes a batch holds before it is written out.
+#define REPLY_BATCH 65536
+// Largest sendfile call, kept under the kernel's per call limit.
+#define REPLY_SENDFILE (1UL << 30)
+// Room for a frame header and the 20 byte segment header after it.
+#define REPLY_HEAD 29
+// Zero copy buffers a connection holds while waiting for their completions.
+#define REPLY_HELD 64
+// Default size from which owned buffers are sent with MSG_ZEROCOPY.
+#define REPLY_ZEROCOPY 65536
+// Entries kept free for the responses to one more message.
+#define REPLY_ROOM 2
+/*
+    Responses queued on a connection, written out together with one sendmsg.
+    Frame headers are kept in heads, and buffers marked in owned are freed once sent,
+    or handed to the entry's release function if it has one.
+    Owned buffers sent with MSG_ZEROCOPY move to held, with the sequence number of
+    their last send, and are freed once the socket's error queue reports it complete.
+    On a non-blocking socket, whatever a send would block on stays queued for a later
+    flush: the unsent entries, marked in zc_open if the first was partly sent with zero
+    copy, and then any file range, from file_pos on its own descriptor.
+*/
+typedef struct reply {
+    int fd;
+    int nonblock;
+    int count;
+    int nheads;
+    size_t bytes;
+    struct iovec iov[REPLY_IOV];
+    void * owned[REPLY_IOV];
+    void (* release[REPLY_IOV])(void *);
+    unsigned char heads[REPLY_IOV][REPLY_HEAD];
+    int zerocopy;
+    uint32_t zc_next;
+    uint32_t zc_done;
+    int nheld;
+    void * held[REPLY_HELD];
+    uint32_t held_seq[REPLY_HELD];
+    int zc_open;
+    int file_fd;
+    off_t file_pos;
+    uint64_t file_left;
+} reply;
+extern size_t reply_zerocopy_min;
+extern unsigned long reply_zerocopy_sent;
+extern unsigned long reply_zerocopy_copied;
+void reply_init(reply * out, int fd);
+void reply_add(reply * out, void * data, size_t length, int owned);
+void reply_shared(reply * out, void * data, size_t length, void (* release)(void *), void * ref);
+unsigned char * reply_head(reply * out, unsigned char header, uint64_t length, size_t extra);
+void reply_frame(reply * out, unsigned char header, void * payload, uint64_t length, int owned);
+int reply_flush(reply * out);
+int reply_pending(reply * out);
+void reply_reap(reply * out);
+void reply_close(reply * out);
+int reply_file(reply * out, int fd, uint64_t offset, uint64_t length);
+#endif
\ No newline at end of file
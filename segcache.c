@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "segcache.h"
+
+/*
+    Encoded segments of served files, by file version and range, with a list from least
+    to most recently used for eviction. held counts the bytes of every ready entry.
+    Requests waiting on an entry being encoded wait on filled.
+*/
+size_t segcache_budget = SEGCACHE_BUDGET;
+unsigned long segcache_hits = 0;
+unsigned long segcache_misses = 0;
+unsigned long segcache_evictions = 0;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t filled = PTHREAD_COND_INITIALIZER;
+static segment * buckets[SEGCACHE_BUCKETS];
+static segment * oldest = NULL;
+static segment * newest = NULL;
+static size_t held = 0;
+
+static unsigned int key_hash(const struct stat * st, uint64_t offset, uint64_t length, uint64_t dict) {
+    uint64_t h = st->st_ino * 0x9e3779b97f4a7c15ULL ^ dict;
+    h ^= st->st_dev + (h << 6) + (h >> 2);
+    h ^= offset * 0xff51afd7ed558ccdULL + (h << 6) + (h >> 2);
+    h ^= length * 0xc4ceb9fe1a85ec53ULL + (h << 6) + (h >> 2);
+    return h % SEGCACHE_BUCKETS;
+}
+
+static int same_key(segment * s, const struct stat * st, uint64_t offset, uint64_t length, uint64_t dict) {
+    return s->dict == dict && s->ino == st->st_ino && s->dev == st->st_dev && s->offset == offset && s->length == length &&
+        s->size == st->st_size && s->mtime.tv_sec == st->st_mtim.tv_sec && s->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+/*
+    Take an entry out of its hash chain and the use list. Called with the lock held.
+*/
+static void unlink_segment(segment * s) {
+    segment ** p = &buckets[s->hash];
+    while (*p != s) {
+        p = &(*p)->next;
+    }
+    *p = s->next;
+    if (s->older != NULL) {
+        s->older->newer = s->newer;
+    }
+    else {
+        oldest = s->newer;
+    }
+    if (s->newer != NULL) {
+        s->newer->older = s->older;
+    }
+    else {
+        newest = s->older;
+    }
+    if (s->ready) {
+        held -= (s->nbits + 7) / 8;
+    }
+}
+
+static void push_newest(segment * s) {
+    s->older = newest;
+    s->newer = NULL;
+    if (newest != NULL) {
+        newest->newer = s;
+    }
+    else {
+        oldest = s;
+    }
+    newest = s;
+}
+/*
+    Free the least recently used ready entries nobody is reading until the cache fits
+    its budget. Called with the lock held.
+*/
+static void evict(void) {
+    segment * s = oldest;
+    while (s != NULL && held > segcache_budget) {
+        segment * next = s->newer;
+        if (s->ready && s->refs == 0) {
+            unlink_segment(s);
+            free(s->bits);
+            free(s);
+            segcache_evictions++;
+        }
+        s = next;
+    }
+}
+/*
+    Find the encoded segment for a range of a file version, encoded with the dictionary
+    whose hash is dict, waiting if another request
+    is encoding it. If nobody is, an empty entry is made and build set, and the caller
+    must encode the range and hand it over with segcache_publish or segcache_abandon.
+    Returns NULL if the range is not cached: too large, or its encoding was abandoned.
+    Every entry returned must be given back with segcache_release.
+*/
+segment * segcache_acquire(const struct stat * st, uint64_t offset, uint64_t length, uint64_t dict, int * build) {
+    *build = 0;
+    if (length > SEGCACHE_LARGEST) {
+        return NULL;
+    }
+    unsigned int h = key_hash(st, offset, length, dict);
+    pthread_mutex_lock(&cache_lock);
+    segment * s = buckets[h];
+    while (s != NULL && !same_key(s, st, offset, length, dict)) {
+        s = s->next;
+    }
+    if (s != NULL) {
+        s->refs++;
+        // Another request is encoding it.
+        while (s->ready == 0) {
+            pthread_cond_wait(&filled, &cache_lock);
+        }
+        if (s->ready != 1) {
+            // The encoding was abandoned.
+            s->refs--;
+            if (s->refs == 0) {
+                free(s);
+            }
+            pthread_mutex_unlock(&cache_lock);
+            return NULL;
+        }
+        segcache_hits++;
+        if (s != newest) {
+            if (s->older != NULL) {
+                s->older->newer = s->newer;
+            }
+            else {
+                oldest = s->newer;
+            }
+            s->newer->older = s->older;
+            push_newest(s);
+        }
+        pthread_mutex_unlock(&cache_lock);
+        return s;
+    }
+    segcache_misses++;
+    s = calloc(1, sizeof(segment));
+    s->dev = st->st_dev;
+    s->ino = st->st_ino;
+    s->size = st->st_size;
+    s->mtime = st->st_mtim;
+    s->offset = offset;
+    s->length = length;
+    s->dict = dict;
+    s->refs = 1;
+    s->hash = h;
+    s->next = buckets[h];
+    buckets[h] = s;
+    push_newest(s);
+    *build = 1;
+    pthread_mutex_unlock(&cache_lock);
+    return s;
+}
+/*
+    Fill in an entry with its encoding, which the cache takes over, and wake its waiters.
+*/
+void segcache_publish(segment * s, unsigned char * bits, uint64_t nbits) {
+    pthread_mutex_lock(&cache_lock);
+    s->bits = bits;
+    s->nbits = nbits;
+    s->ready = 1;
+    held += (nbits + 7) / 8;
+    pthread_cond_broadcast(&filled);
+    pthread_mutex_unlock(&cache_lock);
+}
+/*
+    Give up on filling in an entry, taking it out of the cache. Its waiters encode the range themselves.
+*/
+void segcache_abandon(segment * s) {
+    pthread_mutex_lock(&cache_lock);
+    unlink_segment(s);
+    s->ready = -1;
+    pthread_cond_broadcast(&filled);
+    pthread_mutex_unlock(&cache_lock);
+}
+/*
+    Give back an entry, trimming the cache to its budget.
+*/
+void segcache_release(segment * s) {
+    pthread_mutex_lock(&cache_lock);
+    s->refs--;
+    if (s->ready == -1) {
+        if (s->refs == 0) {
+            free(s);
+        }
+    }
+    else {
+        evict();
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
\ No newline at end of file
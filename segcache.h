@@ -0,0 +1,45 @@
+#ifndef SEGCACHE_H
+#define SEGCACHE_H
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/stat.h>
+// Hash buckets of the cache, keyed by file identity and range.
+#define SEGCACHE_BUCKETS 1024
+// Default cap on the bytes of encoded segments held.
+#define SEGCACHE_BUDGET (256UL << 20)
+// Segments longer than this are always encoded afresh.
+#define SEGCACHE_LARGEST (16UL << 20)
+/*
+    The encoding of one range of one version of a file, without the segment header,
+    which differs per session. A version is told apart by device, inode, size and
+    modification time, so a changed file never matches its old segments, and entries
+    are kept apart by the hash of the dictionary that encoded them. An entry
+    is filled in by the first request for it, and later requests for it wait on that:
+    ready is 0 until then, 1 once filled in, and -1 if the encoding was abandoned.
+*/
+typedef struct segment {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    uint64_t offset;
+    uint64_t length;
+    uint64_t dict;
+    unsigned char * bits;
+    uint64_t nbits;
+    int ready;
+    int refs;
+    unsigned int hash;
+    struct segment * next;
+    struct segment * older;
+    struct segment * newer;
+} segment;
+extern size_t segcache_budget;
+extern unsigned long segcache_hits;
+extern unsigned long segcache_misses;
+extern unsigned long segcache_evictions;
+segment * segcache_acquire(const struct stat * st, uint64_t offset, uint64_t length, uint64_t dict, int * build);
+void segcache_publish(segment * s, unsigned char * bits, uint64_t nbits);
+void segcache_abandon(segment * s);
+void segcache_release(segment * s);
+#endif
\ No newline at end of file
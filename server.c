@@ -10,12 +10,53 @@
 #include <pthread.h>
 #include "message_handling.h"
 #include "tp.h"
+#include "reactor.h"
+#include "uring.h"
 #include "compression.h"
+#include "encpool.h"
 #include <signal.h>
 
 int main(int argc, char ** argv) {
+    // Select the execution mode, threads (one worker per connection) by default.
+    int mode = MODE_THREADS;
+    // Bounds of the worker pool, resized between them as load changes.
+    int min_threads = 4;
+    int max_threads = 100;
+    int opt;
+    long zerocopy;
+    long parallel;
+    while ((opt = getopt(argc, argv, "m:w:z:p:")) != -1) {
+        if (opt == 'm' && strcmp(optarg, "threads") == 0) {
+            mode = MODE_THREADS;
+        }
+        else if (opt == 'm' && strcmp(optarg, "epoll") == 0) {
+            mode = MODE_REACTOR;
+        }
+        else if (opt == 'm' && strcmp(optarg, "uring") == 0) {
+            mode = MODE_URING;
+        }
+        else if (opt == 'm' && strcmp(optarg, "reuseport") == 0) {
+            mode = MODE_REUSEPORT;
+        }
+        else if (opt == 'w' && sscanf(optarg, "%d:%d", &min_threads, &max_threads) == 2 &&
+            min_threads >= 1 && min_threads <= max_threads && max_threads <= 100) {
+            continue;
+        }
+        // Smallest response payload sent with MSG_ZEROCOPY, 0 turns zero copy off.
+        else if (opt == 'z' && sscanf(optarg, "%ld", &zerocopy) == 1 && zerocopy >= 0) {
+            reply_zerocopy_min = zerocopy;
+        }
+        // Smallest payload encoded or decoded in chunks across cores, 0 keeps it on one thread.
+        else if (opt == 'p' && sscanf(optarg, "%ld", &parallel) == 1 && parallel >= 0) {
+            encpool_min = parallel;
+        }
+        else {
+            fprintf(stderr, "Usage: %s [-m threads|epoll|uring|reuseport] [-w min:max] [-z bytes] [-p bytes] <config_file>\n", argv[0]);
+            return 1;
+        }
+    }
     // Verify that the user inputs arguments.
-    if (argc < 2) {
+    if (optind >= argc) {
         return 1;
     }
 
@@ -32,8 +73,21 @@ int main(int argc, char ** argv) {
         return 1;
     }
     server_addr.sin_family = AF_INET;
+    // sendfile has no MSG_NOSIGNAL, a client gone mid file must not kill the server.
+    signal(SIGPIPE, SIG_IGN);
     // Setup thread pool.
-    thread_pool * tp = tp_create(argv[1], &server_addr);
+    thread_pool * tp = tp_create(argv[optind], &server_addr, mode, min_threads, max_threads);
+    // In reuseport mode the workers listen and accept themselves, wait for them to finish.
+    if (tp->mode == MODE_REUSEPORT) {
+        close(sockfd);
+        tp->serversock = -1;
+        for (int i = 0; i < tp->live; i++) {
+            pthread_join(tp->threads[i], NULL);
+        }
+        close(tp->wakefd);
+        free(tp);
+        return 0;
+    }
     int ret;
     // Bind the address to the socket file descriptor.
     if((ret = bind(sockfd, (struct sockaddr * ) &server_addr, sizeof(struct sockaddr_in))) < 0) {
@@ -44,25 +98,42 @@ int main(int argc, char ** argv) {
     tp->serversock = sockfd;
     // Start listening for clients.
     listen(sockfd, 500);
+    // The io_uring backend accepts and serves clients itself, falling back to threads.
+    if (tp->mode == MODE_URING) {
+        if (uring_run(tp) == 0) {
+            close(sockfd);
+            free(tp);
+            return 0;
+        }
+        tp->mode = MODE_THREADS;
+        tp_start(tp);
+    }
     while(1) {
         // Accept clients.
         clfd = accept(sockfd, (struct sockaddr * ) &client, &addr_size);
         // Close on error (or shutdown).
         if (clfd == -1) {
             close(sockfd);
+            if (tp->mode == MODE_REACTOR) {
+                pthread_join(tp->reactor, NULL);
+                close(tp->epfd);
+                close(tp->wakefd);
+            }
+            pthread_join(tp->sizer, NULL);
             free(tp);
             break;
         }
-        int * cl = malloc(sizeof(int));
+        connection * cl = connection_create(clfd);
         if (!cl) {
             perror("Failed to allocate memory for client");
             close(clfd);
             continue;
         }
-        *cl = clfd;
-        pthread_mutex_lock(&tp->mutex);
+        // In reactor mode, workers only see the client once it is readable.
+        if (tp->mode == MODE_REACTOR) {
+            reactor_add(cl, tp);
+            continue;
+        }
         enqueue(cl, tp);
-        pthread_cond_signal(&tp->cond_var);
-        pthread_mutex_unlock(&tp->mutex);
     } 
 }
\ No newline at end of file
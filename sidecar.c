@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <sys/stat.h>
+#include "sidecar.h"
+#include "byteswap_compat.h"
+
+/*
+    Where the sidecar of the file at path lives: the sidecar directory beside it.
+*/
+char * sidecar_path(const char * path) {
+    const char * slash = strrchr(path, '/');
+    size_t dir = slash == NULL ? 0 : slash - path + 1;
+    char * side = malloc(strlen(path) + strlen(SIDECAR_DIR) + 2);
+    memcpy(side, path, dir);
+    strcpy(side + dir, SIDECAR_DIR "/");
+    strcat(side, path + dir);
+    return side;
+}
+
+static uint64_t read_be64(const unsigned char * p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return bswap_64(v);
+}
+/*
+    The bit offset in the encoding of byte pos of the file, from the nearest index entry
+    before it and the code lengths of the bytes in between.
+*/
+static uint64_t bit_offset(const unsigned char * index, const unsigned char * data, uint64_t pos, m_node ** dict) {
+    uint64_t entry = pos / SIDECAR_STRIDE;
+    uint64_t bit = read_be64(index + 8 * entry);
+    for (uint64_t i = entry * SIDECAR_STRIDE; i < pos; i++) {
+        bit += (*dict)[data[i]].code_l;
+    }
+    return bit;
+}
+/*
+    The bits of a range are sliced out of the sidecar into this encoding first, which lives
+    outside the stack frame, so it is still intact after a SIGBUS jumps out of the slicing.
+*/
+static __thread encoder slice;
+/*
+    The served directory this thread last looked in for a sidecar directory, whether it
+    found one, and the count of changes to watched directories when it looked. Until
+    another change is reported, which creating or removing the sidecar directory would
+    be, the answer stands.
+*/
+static __thread char * looked_dir = NULL;
+static __thread int looked_found;
+static __thread unsigned long looked_at;
+/*
+    Whether the directory holding path may have sidecars. Looks for the sidecar directory
+    once per change to the directory, rather than trying to open a sidecar for every range.
+*/
+static int sidecars_possible(const char * path) {
+    const char * slash = strrchr(path, '/');
+    size_t n = slash == NULL ? 0 : slash - path;
+    if (looked_dir != NULL && strlen(looked_dir) == n && strncmp(looked_dir, path, n) == 0 &&
+        looked_at == filecache_changes()) {
+        return looked_found;
+    }
+    unsigned long seen = filecache_changes();
+    char * dir = slash == NULL ? strdup(".") : strndup(path, n);
+    char * side = malloc(strlen(dir) + strlen(SIDECAR_DIR) + 2);
+    snprintf(side, strlen(dir) + strlen(SIDECAR_DIR) + 2, "%s/%s", dir, SIDECAR_DIR);
+    struct stat st;
+    int found = stat(side, &st) == 0 && S_ISDIR(st.st_mode);
+    free(side);
+    // Without a watch nothing would report the directory changing, so look every time.
+    if (filecache_watch(dir)) {
+        free(looked_dir);
+        looked_dir = dir;
+        looked_found = found;
+        looked_at = seen;
+        return found;
+    }
+    free(dir);
+    return found;
+}
+/*
+    Append the encoding of a range of the file m to e, sliced from the file's sidecar.
+    Returns 0 if there is no sidecar for this version of the file and this dictionary,
+    in which case e is untouched.
+*/
+int sidecar_splice(encoder * e, file_map * m, uint64_t offset, uint64_t length, m_node ** dict) {
+    if (!sidecars_possible(m->path)) {
+        return 0;
+    }
+    char * path = sidecar_path(m->path);
+    file_map * side = filecache_acquire(path);
+    free(path);
+    if (side == NULL) {
+        return 0;
+    }
+    const unsigned char * head = filecache_data(side);
+    const unsigned char * data = filecache_data(m);
+    uint64_t size = m->st.st_size;
+    uint64_t entries = size / SIDECAR_STRIDE + 1;
+    if (head == NULL || (data == NULL && size > 0) || side->length < SIDECAR_HEADER + 8 * entries ||
+        memcmp(head, SIDECAR_MAGIC, 4) != 0 || offset + length > size) {
+        filecache_release(side);
+        return 0;
+    }
+    uint32_t stride;
+    memcpy(&stride, head + 4, 4);
+    uint64_t nbits = read_be64(head + 40);
+    if (bswap_32(stride) != SIDECAR_STRIDE || read_be64(head + 8) != size ||
+        read_be64(head + 16) != (uint64_t) m->st.st_mtim.tv_sec || read_be64(head + 24) != (uint64_t) m->st.st_mtim.tv_nsec ||
+        read_be64(head + 32) != dict_hash(dict) || read_be64(head + 48) != entries ||
+        side->length < SIDECAR_HEADER + 8 * entries + (nbits + 7) / 8) {
+        filecache_release(side);
+        return 0;
+    }
+    const unsigned char * index = head + SIDECAR_HEADER;
+    const unsigned char * bits = index + 8 * entries;
+    encoder * d = &slice;
+    encode_start(d);
+    sigjmp_buf jb;
+    if (sigsetjmp(jb, 1) != 0) {
+        // The file or its sidecar was truncated while being read.
+        filecache_guard(NULL);
+        free(d->buffer);
+        filecache_invalidate(side);
+        filecache_release(side);
+        return 0;
+    }
+    filecache_guard(&jb);
+    uint64_t start = bit_offset(index, data, offset, dict);
+    uint64_t end = bit_offset(index, data, offset + length, dict);
+    if (end >= start && end <= nbits) {
+        encode_append(d, bits, start, end - start);
+    }
+    filecache_guard(NULL);
+    filecache_release(side);
+    if (end < start || end > nbits) {
+        return 0;
+    }
+    encode_append(e, d->buffer, 0, d->bits);
+    free(d->buffer);
+    return 1;
+}
\ No newline at end of file
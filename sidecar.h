@@ -0,0 +1,22 @@
+#ifndef SIDECAR_H
+#define SIDECAR_H
+#include <stdint.h>
+#include "compression.h"
+#include "filecache.h"
+// Subdirectory of the served directory holding the sidecars, hidden from listings.
+#define SIDECAR_DIR ".sidecars"
+#define SIDECAR_MAGIC "HSC1"
+// Bytes of the file between the bit offsets kept in the index.
+#define SIDECAR_STRIDE 4096
+// Magic, stride, file size, mtime seconds and nanoseconds, dictionary hash, encoded bits, index entries.
+#define SIDECAR_HEADER 56
+/*
+    A sidecar holds the whole file encoded with the dictionary, ahead of time. Since every
+    byte has a fixed code, the encoding of any range of the file is a run of bits in the
+    sidecar. The index gives the bit offset of every SIDECAR_STRIDE'th byte of the file,
+    and the code lengths of the bytes after it locate the rest. All numbers are stored in
+    network byte order, and the file's size and mtime tie the sidecar to one version of it.
+*/
+char * sidecar_path(const char * path);
+int sidecar_splice(encoder * e, file_map * m, uint64_t offset, uint64_t length, m_node ** dict);
+#endif
\ No newline at end of file
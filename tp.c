@@ -1,205 +1,574 @@
 #include <pthread.h>
+#include <stdio.h>
+#include <time.h>
 #include "tp.h"
 #include <netinet/in.h>
 #include "message_handling.h"
 #include "compression.h"
 #include "multiplexlist.h"
 #include "byteswap_compat.h"
+#include "reactor.h"
+#include "dirindex.h"
+#include "segcache.h"
+#include "dictionary.h"
+
+// How often the sizer samples the pool.
+#define SIZER_PERIOD_MS 100
+// Average queue wait above which the pool grows.
+#define GROW_WAIT_US 2000
+// Sizer periods the pool must sit mostly idle before a worker is retired.
+#define SHRINK_PERIODS 20
+
+static void * pool_sizer(void * args);
+static int pool_grow(thread_pool * tp);
 /*
     Create a thread pool, and store compression dict and config details within.
+    In reactor mode the pool is fed by an epoll reactor rather than the accept loop,
+    and in reuseport mode every worker accepts from its own listening socket.
+    The pool starts min_threads workers and is resized up to max_threads by the sizer,
+    except in reuseport mode, where min_threads shards run for the server's lifetime, and
+    in uring mode, where no pool is started.
 */
-thread_pool * tp_create(char * config_name, struct sockaddr_in * sock) {
+thread_pool * tp_create(char * config_name, struct sockaddr_in * sock, int mode,
+    int min_threads, int max_threads) {
     thread_pool * tp = malloc (sizeof(thread_pool));
-    pthread_cond_init(&tp->cond_var, NULL);
-    pthread_mutex_init(&tp->mutex, NULL);
-    tp->head = NULL;
-    tp->tail = NULL;
     tp->shut = 0;
-    create_map(&(tp->data.dict));
-    for (int i = 0 ; i < 20; i++) {
-        if (pthread_create(&(tp->threads[i]), NULL, thread_worker, tp) != 0) {
-            perror("pthread_create failed");
-            exit(1);
-        }
+    tp->mode = mode;
+    tp->epfd = -1;
+    tp->wakefd = -1;
+    tp->started = 0;
+    tp->nthreads = max_threads;
+    tp->min_threads = min_threads;
+    tp->live = 0;
+    tp->next = 0;
+    tp->idle = 0;
+    tp->wait_ns = 0;
+    tp->waits = 0;
+    tp->resizes = 0;
+    for (int i = 0; i < tp->nthreads; i++) {
+        deque * dq = &tp->queues[i];
+        dq->capacity = 64;
+        dq->items = malloc(dq->capacity * sizeof(task));
+        dq->top = 0;
+        dq->bottom = 0;
+        dq->parked = 0;
+        dq->active = 0;
+        dq->retire = 0;
+        dq->pool = tp;
+        pthread_mutex_init(&dq->lock, NULL);
+        pthread_cond_init(&dq->wake, NULL);
     }
+    dictionary_start();
+    // Shards bind their own listeners, so the address is needed before they start.
     get_config(config_name, sock, &(tp->data.directory));
+    dirindex_build(tp->data.directory);
+    tp->addr = *sock;
     tp->requests_list = create();
+    if (mode == MODE_REACTOR && reactor_create(tp) == -1) {
+        exit(1);
+    }
+    if (mode == MODE_REUSEPORT) {
+        if (shard_create(tp) == -1) {
+            exit(1);
+        }
+        for (int i = 0 ; i < min_threads; i++) {
+            if (pthread_create(&(tp->threads[i]), NULL, reactor_shard, tp) != 0) {
+                perror("pthread_create failed");
+                exit(1);
+            }
+        }
+        tp->live = min_threads;
+        return tp;
+    }
+    // The io_uring backend serves clients on the main thread, the pool is only started
+    // if it falls back to threads.
+    if (mode != MODE_URING) {
+        tp_start(tp);
+    }
     return tp;
 }
 /*
-    Dequeue work from the thread pool.
+    Start min_threads workers and the sizer.
+*/
+void tp_start(thread_pool * tp) {
+    for (int i = 0 ; i < tp->min_threads; i++) {
+        if (pool_grow(tp) == -1) {
+            perror("pthread_create failed");
+            exit(1);
+        }
+    }
+    if (pthread_create(&tp->sizer, NULL, pool_sizer, tp) != 0) {
+        perror("pthread_create failed");
+        exit(1);
+    }
+}
+/*
+    Index of the calling worker's deque, or -1 on threads outside the pool.
+*/
+static __thread int worker_id = -1;
+/*
+    Monotonic clock in nanoseconds, used to time how long work sits queued.
+*/
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+/*
+    Push work on the bottom of a deque, doubling the buffer when it is full.
+    The bottom index is stored sequentially consistent, as thieves peek at it without the lock.
+*/
+static void deque_push(deque * dq, connection * cl) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom - dq->top == dq->capacity) {
+        task * grown = malloc(2 * dq->capacity * sizeof(task));
+        for (unsigned long i = dq->top; i < dq->bottom; i++) {
+            grown[i % (2 * dq->capacity)] = dq->items[i % dq->capacity];
+        }
+        free(dq->items);
+        dq->items = grown;
+        dq->capacity *= 2;
+    }
+    dq->items[dq->bottom % dq->capacity].cl = cl;
+    dq->items[dq->bottom % dq->capacity].queued = now_ns();
+    __atomic_store_n(&dq->bottom, dq->bottom + 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&dq->lock);
+}
+/*
+    Pop the newest work from the bottom of the owner's deque.
+*/
+static task * deque_pop(deque * dq, task * out) {
+    task * toret = NULL;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom != dq->top) {
+        __atomic_store_n(&dq->bottom, dq->bottom - 1, __ATOMIC_SEQ_CST);
+        *out = dq->items[dq->bottom % dq->capacity];
+        toret = out;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return toret;
+}
+/*
+    Take the oldest work from the top of another worker's deque.
+*/
+static task * deque_steal(deque * dq, task * out) {
+    task * toret = NULL;
+    // Skip empty deques without taking their lock.
+    if (__atomic_load_n(&dq->bottom, __ATOMIC_SEQ_CST) == __atomic_load_n(&dq->top, __ATOMIC_SEQ_CST)) {
+        return NULL;
+    }
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom != dq->top) {
+        *out = dq->items[dq->top % dq->capacity];
+        __atomic_store_n(&dq->top, dq->top + 1, __ATOMIC_SEQ_CST);
+        toret = out;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return toret;
+}
+/*
+    Find work for a worker: its own deque first, then every other deque in turn,
+    starting after itself so thieves spread out over the victims. Deques of
+    retired workers are still searched, so work left on them is never lost.
 */
-int * dequeue(thread_pool * input) {
-    if (input->head == NULL) {
+static connection * find_work(thread_pool * input, int self) {
+    task t;
+    task * found = deque_pop(&input->queues[self], &t);
+    for (int i = 1; found == NULL && i < input->nthreads; i++) {
+        found = deque_steal(&input->queues[(self + i) % input->nthreads], &t);
+    }
+    if (found == NULL) {
         return NULL;
     }
-    else {
-        int * toret = input->head->clfd;
-        Node * tmp = input->head;
-        input->head = input->head->next;
-        if (input->head == NULL) {
-            input->tail = NULL;
+    __atomic_fetch_add(&input->wait_ns, now_ns() - t.queued, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&input->waits, 1, __ATOMIC_RELAXED);
+    return t.cl;
+}
+/*
+    Wake one parked worker, if any are parked, so it can steal the work just queued.
+*/
+static void wake_one(thread_pool * input) {
+    if (__atomic_load_n(&input->idle, __ATOMIC_SEQ_CST) == 0) {
+        return;
+    }
+    for (int i = 0; i < input->nthreads; i++) {
+        deque * dq = &input->queues[i];
+        if (__atomic_load_n(&dq->parked, __ATOMIC_SEQ_CST) == 0) {
+            continue;
+        }
+        pthread_mutex_lock(&dq->lock);
+        int woke = dq->parked;
+        if (woke) {
+            __atomic_store_n(&dq->parked, 0, __ATOMIC_SEQ_CST);
+            __atomic_fetch_sub(&input->idle, 1, __ATOMIC_SEQ_CST);
+            pthread_cond_signal(&dq->wake);
+        }
+        pthread_mutex_unlock(&dq->lock);
+        if (woke) {
+            return;
         }
-        free(tmp);
-        return toret;
     }
 }
 /*
-    Enqueue work (a socket descriptor) on the thread pool.
+    Wait for work for the calling worker. Returns NULL once the pool is shut or the
+    sizer retires the worker. A worker with nothing to run or steal parks on its own
+    condition variable, so waking it never touches a lock shared by the whole pool.
 */
-void enqueue(int * clfd, thread_pool * input) {
-    Node * toadd = malloc(sizeof(Node));
-    toadd->clfd = clfd;
-    toadd->next = NULL;
-    if (input->tail == NULL) {
-        input->head = toadd;
+connection * dequeue(thread_pool * input) {
+    deque * own = &input->queues[worker_id];
+    while (input->shut == 0 && own->retire == 0) {
+        connection * cl = find_work(input, worker_id);
+        if (cl != NULL) {
+            return cl;
+        }
+        /*
+            Mark the worker parked before looking again, so work queued
+            after the first look either is found here or wakes the worker.
+        */
+        pthread_mutex_lock(&own->lock);
+        __atomic_store_n(&own->parked, 1, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&input->idle, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&own->lock);
+        cl = find_work(input, worker_id);
+        pthread_mutex_lock(&own->lock);
+        if (cl != NULL && own->parked) {
+            __atomic_store_n(&own->parked, 0, __ATOMIC_SEQ_CST);
+            __atomic_fetch_sub(&input->idle, 1, __ATOMIC_SEQ_CST);
+        }
+        while (cl == NULL && own->parked && input->shut == 0) {
+            pthread_cond_wait(&own->wake, &own->lock);
+        }
+        pthread_mutex_unlock(&own->lock);
+        if (cl != NULL) {
+            return cl;
+        }
     }
-    else {
-        input->tail->next = toadd;
+    return NULL;
+}
+/*
+    Enqueue work (a client connection) from outside the pool. The deques of running
+    workers are picked in turn, and a parked worker is woken to steal it if the owner is busy.
+*/
+void enqueue(connection * cl, thread_pool * input) {
+    unsigned n = 0;
+    for (int i = 0; i < input->nthreads; i++) {
+        n = __atomic_fetch_add(&input->next, 1, __ATOMIC_RELAXED) % input->nthreads;
+        if (__atomic_load_n(&input->queues[n].active, __ATOMIC_RELAXED)) {
+            break;
+        }
     }
-    input->tail = toadd;
+    deque_push(&input->queues[n], cl);
+    wake_one(input);
 }
 /*
-    Main thread loop, waits for work at condition variable.
-    Jumps back to loop start if socket descriptor closed.
+    Queue a continuation on the calling worker's own deque. The worker picks it up
+    next, unless an idle worker steals it first.
+*/
+void push_local(connection * cl, thread_pool * input) {
+    if (worker_id == -1) {
+        enqueue(cl, input);
+        return;
+    }
+    deque_push(&input->queues[worker_id], cl);
+    wake_one(input);
+}
+/*
+    Main thread loop, takes work from its own deque or steals it from others.
+    A retired worker detaches and frees its slot for the sizer to reuse.
 */
 void * thread_worker(void * args) {
-    thread_pool * input = (thread_pool *) args;
+    deque * own = (deque *) args;
+    thread_pool * input = own->pool;
+    worker_id = own - input->queues;
+    connection * cl;
+    while ((cl = dequeue(input)) != NULL) {
+        if (input->mode == MODE_REACTOR) {
+            reactor_serve(cl, input);
+        }
+        else {
+            client_handling(cl, input);
+        }
+    }
+    if (input->shut == 0) {
+        pthread_detach(pthread_self());
+        pthread_mutex_lock(&own->lock);
+        own->retire = 0;
+        int left = own->bottom != own->top;
+        __atomic_store_n(&own->active, 0, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&own->lock);
+        __atomic_fetch_sub(&input->live, 1, __ATOMIC_SEQ_CST);
+        // Anything still queued here is stolen by the others.
+        if (left) {
+            wake_one(input);
+        }
+    }
+    return NULL;
+}
+/*
+    Start a worker on the first free slot. Returns -1 when the pool is at its maximum
+    or the thread could not be created.
+*/
+static int pool_grow(thread_pool * tp) {
+    for (int i = 0; i < tp->nthreads; i++) {
+        deque * dq = &tp->queues[i];
+        if (__atomic_load_n(&dq->active, __ATOMIC_SEQ_CST) || dq->retire) {
+            continue;
+        }
+        __atomic_store_n(&dq->active, 1, __ATOMIC_SEQ_CST);
+        if (pthread_create(&(tp->threads[i]), NULL, thread_worker, dq) != 0) {
+            __atomic_store_n(&dq->active, 0, __ATOMIC_SEQ_CST);
+            return -1;
+        }
+        __atomic_fetch_add(&tp->live, 1, __ATOMIC_SEQ_CST);
+        return 0;
+    }
+    return -1;
+}
+/*
+    Retire the parked worker on the highest slot. Returns -1 when every worker is busy.
+*/
+static int pool_shrink(thread_pool * tp) {
+    for (int i = tp->nthreads - 1; i >= 0; i--) {
+        deque * dq = &tp->queues[i];
+        if (__atomic_load_n(&dq->active, __ATOMIC_SEQ_CST) == 0) {
+            continue;
+        }
+        pthread_mutex_lock(&dq->lock);
+        int retired = dq->parked;
+        if (retired) {
+            __atomic_store_n(&dq->parked, 0, __ATOMIC_SEQ_CST);
+            __atomic_fetch_sub(&tp->idle, 1, __ATOMIC_SEQ_CST);
+            dq->retire = 1;
+            pthread_cond_signal(&dq->wake);
+        }
+        pthread_mutex_unlock(&dq->lock);
+        if (retired) {
+            return 0;
+        }
+    }
+    return -1;
+}
+/*
+    Sizer thread loop. Every period it reads the average time work sat queued and how
+    many workers are parked. The pool grows when work waits too long or queues up with
+    every worker busy, and loses a worker each period once it has sat mostly idle for a while.
+    Each resize is logged along with the figures that triggered it.
+*/
+static void * pool_sizer(void * args) {
+    thread_pool * tp = (thread_pool *) args;
+    struct timespec period = {0, SIZER_PERIOD_MS * 1000000L};
+    int quiet = 0;
     while (1) {
-        if (input->shut == 1) {
-            return NULL;
-        }
-        pthread_mutex_lock(&input->mutex);
-        int * clfd;
-        // Wait on the condition variable.
-        while ((clfd = dequeue(input)) == NULL) {
-            pthread_cond_wait(&input->cond_var, &input->mutex);
-            if (input->shut == 1) {
-                break;
+        nanosleep(&period, NULL);
+        if (tp->shut == 1) {
+            break;
+        }
+        uint64_t waits = __atomic_exchange_n(&tp->waits, 0, __ATOMIC_RELAXED);
+        uint64_t wait_ns = __atomic_exchange_n(&tp->wait_ns, 0, __ATOMIC_RELAXED);
+        uint64_t wait_us = waits == 0 ? 0 : wait_ns / waits / 1000;
+        int live = __atomic_load_n(&tp->live, __ATOMIC_SEQ_CST);
+        int idle = __atomic_load_n(&tp->idle, __ATOMIC_SEQ_CST);
+        unsigned long queued = 0;
+        for (int i = 0; i < tp->nthreads; i++) {
+            queued += __atomic_load_n(&tp->queues[i].bottom, __ATOMIC_SEQ_CST) -
+                __atomic_load_n(&tp->queues[i].top, __ATOMIC_SEQ_CST);
+        }
+        int grown = 0;
+        if ((wait_us > GROW_WAIT_US || (queued > 0 && idle == 0)) && live < tp->nthreads) {
+            // Start a worker for each queued client, and at least a quarter more.
+            unsigned long add = queued > (unsigned long) live / 4 ? queued : (unsigned long) live / 4;
+            for (unsigned long i = 0; i < (add > 0 ? add : 1) && pool_grow(tp) == 0; i++) {
+                grown++;
             }
+            quiet = 0;
         }
-        if (input->shut == 1) {
-            break;
+        else if (idle * 2 > live && queued == 0 && live > tp->min_threads) {
+            quiet++;
         }
-        pthread_mutex_unlock(&input->mutex);
-        if (clfd != NULL) {
-            client_handling(clfd, input);
+        else {
+            quiet = 0;
         }
-        if (input->shut == 1) {
-            break;
+        int retired = quiet >= SHRINK_PERIODS && pool_shrink(tp) == 0;
+        if (grown > 0 || retired) {
+            tp->resizes++;
+            printf("Pool resized to %d workers (%d busy, %lu queued, %lu us average wait)\n",
+                live + grown - retired, live - idle, queued, (unsigned long) wait_us);
+            fflush(stdout);
         }
     }
     return NULL;
 }
 
-void client_handling(int * clfd, thread_pool * input) {
-    int main = *clfd;
-        while (1) {
-            // If the server has been shutdown, break from the loop.
-            if (input->shut == 1) {
-                return;
-            }
-            // Get the message from client.
-            message * msg = get_description(main, &(input->data.dict));
-
-            //  If the client closed the connection, break from the loop.
-            if (msg == NULL) {
-                close(main);
-                free(clfd);
-                return;
-            }
-            // If the error message is received, break from the loop.
-            if (msg->main.type != 0 && msg->main.type != 2 && 
-                msg->main.type != 4 && msg->main.type != 6 && msg->main.type != 8) {
+/*
+    Serve one message from a client, then queue the connection again as a
+    continuation, so other work queued on this worker can be stolen meanwhile.
+*/
+void client_handling(connection * cl, thread_pool * input) {
+    // If the server has been shutdown, drop the client.
+    if (input->shut == 1) {
+        return;
+    }
+    if (process_message(cl, input) == 1) {
+        push_local(cl, input);
+    }
+}
+/*
+    Handle a message of a known type other than shutdown, using the dictionary in dict.
+    Returns 1 when the connection stays open, 0 once it has been closed, and
+    MESSAGE_PARKED for a child retrieval left waiting on the parent.
+*/
+static int handle_message(connection * cl, thread_pool * input, message * msg, m_node ** dict) {
+    reply * main = &cl->out;
+    decode_payload(msg, dict);
+    // Echo handling.
+    if (msg->main.type == 0x0) {
+        echo(main, msg, dict);
+    }
+    // Directory send handling.
+    if (msg->main.type == 0x2) {
+        directory_send(main, &msg, (input->data.directory), dict);
+    }
+    // Send file size handling.
+    if (msg->main.type == 0x4) {
+        file_size_response(main, &msg, input->data.directory, dict);
+    }
+    if (msg->main.type == 0x6){
+        file_request * req = dissect_file_request(msg);
+        //find if a request already exists.
+        file_request * curr = NULL;
+        // Find if the request exists in the list already.
+        if ((curr = find(&(input->requests_list), req))) {
+            // If any of the properties are not the same in the received request, error.
+            if (strcmp((char*)req->file_name, (char*)curr->file_name) != 0 || 
+                req->length != curr->length || 
+                    req->offset != curr->offset) {
                 error_send(main);
-                close(main);
-                free(clfd);
+                connection_close(cl);
+                free(req->file_name);
+                free(req);
                 free(msg->buffer);
                 free(msg);
-                return;
+                return 0;
             }
-            // Echo handling.
-            if (msg->main.type == 0x0) {
-                echo(main, msg, &(input->data.dict));
-            }
-            // Directory send handling.
-            if (msg->main.type == 0x2) {
-                directory_send(main, &msg, (input->data.directory), &(input->data.dict));
-            }
-            // Send file size handling.
-            if (msg->main.type == 0x4) {
-                file_size_response(main, &msg, input->data.directory, &(input->data.dict));
-            }
-            if (msg->main.type == 0x6){
-                file_request * req = dissect_file_request(msg);
-                //find if a request already exists.
-                file_request * curr = NULL;
-                // Find if the request exists in the list already.
-                if ((curr = find(&(input->requests_list), req))) {
-                    // If any of the properties are not the same in the received request, error.
-                    if (strcmp((char*)req->file_name, (char*)curr->file_name) != 0 || 
-                        req->length != curr->length || 
-                            req->offset != curr->offset) {
-                        error_send(main);
-                        free(clfd);
-                        free(msg->buffer);
-                        free(msg);
-                        return;
-                    }
-                    else {
-                        // Handle a message sent from child.
-                        pthread_mutex_lock(&curr->node_lock);
-                        curr->num_connect++;
-                        pthread_mutex_unlock(&curr->node_lock);
-                        child_send(main, msg->main.requires_compression, 
-                            input->data.directory, &curr, &(input->data.dict));
-                        close(main);
-                        free(req->file_name);
-                        free(req);
-                        free(msg->buffer);
-                        free(msg);
-                        free(clfd);
-                        return;
-                    }
+            else {
+                // Handle a message sent from child.
+                pthread_mutex_lock(&curr->node_lock);
+                curr->num_connect++;
+                pthread_mutex_unlock(&curr->node_lock);
+                if (input->mode == MODE_REUSEPORT) {
+                    // A shard serves all of its clients, so it waits for the pipe in its epoll set.
+                    cl->wait = child_park(cl, msg->main.requires_compression,
+                        input->data.directory, curr);
                 }
                 else {
-                    // Add file request to the list.
-                    pipe(req->pipefd);
-                    pthread_mutex_init(&req->node_lock, NULL);
-                    req->num_connect = 0;
-                    add(&(input->requests_list), req);
-                    parent_send(main, msg->main.requires_compression, 
-                        input->data.directory, &req, &(input->data.dict));
-                    remove_node(&(input->requests_list), req);
-               }
-               
-            }
-            // Shut down server.
-            if (msg->main.type == 0x8) {
-                close(main);
-                free(clfd);
-                free(msg);
-                input->shut = 1;
-                pthread_cond_broadcast(&input->cond_var);
-                int * f;
-                while((f = dequeue(input)) != NULL) {
-                    close(*f);
-                    free(f);
+                    child_send(main, msg->main.requires_compression, 
+                        input->data.directory, &curr, dict);
                 }
-                for (int i = 0; i < 256; i++) {
-                    free(input->data.dict[i].code);
+                free(req->file_name);
+                free(req);
+                free(msg->buffer);
+                free(msg);
+                if (cl->wait != NULL) {
+                    return MESSAGE_PARKED;
                 }
-                // Free all of the structures attached to the thread pool.
-                free(input->data.dict);
-                free(input->data.directory);
-                free(input->requests_list);
-                /* Send shutdown to main server socket,
-                cancelling accept blocking.
-                */
-                shutdown(input->serversock, SHUT_RDWR);
-                return;
+                connection_close(cl);
+                return 0;
             }
-            free(msg->buffer);
-            free(msg);
         }
+        else {
+            // Add file request to the list.
+            pipe(req->pipefd);
+            pthread_mutex_init(&req->node_lock, NULL);
+            req->num_connect = 0;
+            add(&(input->requests_list), req);
+            parent_send(main, msg->main.requires_compression, 
+                input->data.directory, &req, dict);
+            remove_node(&(input->requests_list), req);
+        }
+    }
+    free(msg->buffer);
+    free(msg);
+    return 1;
+}
+/*
+    Read and handle a single message from the client. Returns 1 while the connection
+    stays open, 0 once it has been closed and cl freed, -1 when a non-blocking
+    receive has run out of bytes before a whole frame arrived, and MESSAGE_PARKED
+    when a child retrieval waits on cl->wait (reuseport mode only).
+*/
+int process_message(connection * cl, thread_pool * input) {
+    // Only the thread pool's own mode reads with blocking receives.
+    int flags = input->mode == MODE_THREADS ? 0 : MSG_DONTWAIT;
+    // Get the message from client.
+    message * msg;
+    int status = get_description(cl, &msg, flags);
+    if (status == -1) {
+        return -1;
+    }
+    //  If the client closed the connection, break from the loop.
+    if (status == 0) {
+        connection_close(cl);
+        return 0;
+    }
+    // If the error message is received, break from the loop.
+    if (msg->main.type != 0 && msg->main.type != 2 && 
+        msg->main.type != 4 && msg->main.type != 6 && msg->main.type != 8) {
+        error_send(&cl->out);
+        connection_close(cl);
+        free(msg->buffer);
+        free(msg);
+        return 0;
+    }
+    // Shut down server.
+    if (msg->main.type == 0x8) {
+        connection_close(cl);
+        free(msg);
+        shutter(input);
+        return 0;
+    }
+    // The whole message is handled with the dictionary current when it was received.
+    // A reply larger than REPLY_BATCH is partly sent from within the section, so a
+    // reload can wait on a slow client for that long; a child waiting on its parent
+    // leaves the section meanwhile.
+    m_node * dict = dictionary_enter();
+    status = handle_message(cl, input, msg, &dict);
+    dictionary_exit();
+    return status;
+}
+/*
+    Shut the server down: wake the workers, drop queued clients, free the
+    structures attached to the thread pool and stop the accept loop.
+*/
+void shutter(thread_pool * input) {
+    input->shut = 1;
+    printf("Zero copy sends: %lu without copying, %lu copied\n",
+        __atomic_load_n(&reply_zerocopy_sent, __ATOMIC_RELAXED),
+        __atomic_load_n(&reply_zerocopy_copied, __ATOMIC_RELAXED));
+    printf("Segment cache: %lu hits, %lu misses, %lu evictions\n",
+        __atomic_load_n(&segcache_hits, __ATOMIC_RELAXED),
+        __atomic_load_n(&segcache_misses, __ATOMIC_RELAXED),
+        __atomic_load_n(&segcache_evictions, __ATOMIC_RELAXED));
+    fflush(stdout);
+    for (int i = 0; i < input->nthreads; i++) {
+        pthread_mutex_lock(&input->queues[i].lock);
+        pthread_cond_signal(&input->queues[i].wake);
+        pthread_mutex_unlock(&input->queues[i].lock);
+    }
+    if (input->mode == MODE_REACTOR || input->mode == MODE_REUSEPORT) {
+        reactor_wake(input);
+    }
+    task f;
+    for (int i = 0; i < input->nthreads; i++) {
+        while(deque_steal(&input->queues[i], &f) != NULL) {
+            connection_close(f.cl);
+        }
+    }
+    // Free all of the structures attached to the thread pool.
+    dictionary_close();
+    free(input->data.directory);
+    free(input->requests_list);
+    /* Send shutdown to main server socket,
+    cancelling accept blocking.
+    */
+    shutdown(input->serversock, SHUT_RDWR);
 }
\ No newline at end of file
@@ -4,11 +4,77 @@
 #include <sys/types.h>
 #include <stdint.h>
 #include "multiplexlist.h"
+#include "reply.h"
 #include <netinet/in.h>
-typedef struct Node {
-    int * clfd;
-    struct Node * next;
-} Node;
+struct thread_pool;
+struct message;
+/*
+    Receive buffer size for a connection's parser.
+*/
+#define PARSER_BUFFER 16384
+#define PARSE_HEADER 0
+#define PARSE_LENGTH 1
+#define PARSE_PAYLOAD 2
+/*
+    Progress through the frames a client sends. Bytes are received into in, and the
+    stage, length bytes and payload bytes seen so far carry over between receives,
+    so a frame split across reads resumes where it stopped.
+*/
+typedef struct parser {
+    int stage;
+    unsigned char length[8];
+    uint64_t got;
+    struct message * msg;
+    unsigned char * in;
+    size_t in_len;
+    size_t in_pos;
+} parser;
+/*
+    A child retrieval waiting in a shard's epoll set for its share of the range,
+    on its own descriptor for the parent's pipe.
+*/
+typedef struct child_wait {
+    int fd;
+    int compressed;
+    uint32_t session_id;
+    char * path;
+} child_wait;
+/*
+    A client connection, its parser state and the responses waiting to be sent.
+    closing marks a shard client to be closed once its queued responses have gone.
+*/
+typedef struct connection {
+    int fd;
+    parser in;
+    reply out;
+    child_wait * wait;
+    int closing;
+} connection;
+// process_message parked a child retrieval on its wait, in reuseport mode.
+#define MESSAGE_PARKED 2
+/*
+    Queued work, a client connection and the time it was queued at.
+*/
+typedef struct task {
+    connection * cl;
+    uint64_t queued;
+} task;
+/*
+    A worker's run queue. The owner pushes and pops at the bottom, thieves take
+    the oldest entry from the top. The buffer doubles when full, so work is never dropped.
+*/
+typedef struct deque {
+    task * items;
+    unsigned long capacity;
+    unsigned long top;
+    unsigned long bottom;
+    int parked;
+    int active;
+    int retire;
+    struct thread_pool * pool;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} deque;
 typedef struct map_node {
     unsigned char byte;
     uint8_t code_l;
@@ -18,22 +84,43 @@ typedef struct lifetime_data {
     char * directory;
     m_node * dict;
 } lifetime_data;
+#define MODE_THREADS 0
+#define MODE_REACTOR 1
+#define MODE_URING 2
+#define MODE_REUSEPORT 3
 typedef struct thread_pool {
     int serversock;
-    pthread_cond_t cond_var;
-    pthread_mutex_t mutex;
+    int mode;
+    int epfd;
+    int wakefd;
+    pthread_t reactor;
+    struct sockaddr_in addr;
+    int listeners[100];
+    int started;
     pthread_t threads[100];
+    deque queues[100];
+    int nthreads;
+    int min_threads;
+    int live;
+    unsigned next;
+    int idle;
+    pthread_t sizer;
+    uint64_t wait_ns;
+    uint64_t waits;
+    int resizes;
     int shut;
     lifetime_data data;
     List * requests_list;
-    Node * head;
-    Node * tail;
 } thread_pool;
 
-thread_pool * tp_create(char * config_name , struct sockaddr_in *sock);
-int * dequeue(thread_pool *input);
-void enqueue(int * clfd, thread_pool * input);
+thread_pool * tp_create(char * config_name , struct sockaddr_in *sock, int mode,
+    int min_threads, int max_threads);
+void tp_start(thread_pool * tp);
+connection * dequeue(thread_pool *input);
+void enqueue(connection * cl, thread_pool * input);
+void push_local(connection * cl, thread_pool * input);
 void * thread_worker(void * args);
-void shutter();
-void client_handling(int * clfd, thread_pool * input);
+void shutter(thread_pool * input);
+void client_handling(connection * cl, thread_pool * input);
+int process_message(connection * cl, thread_pool * input);
 #endif
\ No newline at end of file
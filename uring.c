@@ -0,0 +1,710 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "uring.h"
+#include "message_handling.h"
+#include "compression.h"
+#include "multiplexlist.h"
+#include "byteswap_compat.h"
+#include "dirindex.h"
+#include "dictionary.h"
+
+#define URING_ENTRIES 256
+// Size of the sparse fixed file table used for direct (registered) file descriptors.
+#define URING_FILES 1024
+// Largest single read or send, the SQE length field is 32 bits.
+#define URING_CHUNK (1UL << 30)
+// Room needed for the longest chain, so a chain is never split across submissions.
+#define URING_CHAIN 32
+
+/*
+    Operation tags, stored in the low bits of each submission's user_data.
+    The remaining bits hold the connection (malloc'd, so 16 byte aligned).
+*/
+#define OP_ACCEPT 0
+#define OP_HEADER 1
+#define OP_LENGTH 2
+#define OP_BODY 3
+#define OP_STATX 4
+#define OP_PIPE 5
+#define OP_OPEN 6
+#define OP_READ 7
+#define OP_CLOSE 8
+#define OP_SEND 9
+#define OP_MASK 0xf
+
+typedef struct uring {
+    int fd;
+    unsigned * sq_head;
+    unsigned * sq_tail;
+    unsigned * sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned * cq_head;
+    unsigned * cq_tail;
+    unsigned cq_mask;
+    struct io_uring_sqe * sqes;
+    struct io_uring_cqe * cqes;
+    unsigned tail;
+    unsigned queued;
+    int multishot;
+    int slots[URING_FILES];
+    int free_slots;
+} uring;
+
+typedef struct uring_conn {
+    int fd;
+    int inflight;
+    int closing;
+    // A linked chain failed, recover once its remaining completions arrive.
+    int failed;
+    // Close the connection once the current response has been sent.
+    int last;
+    int compressed;
+    int slot;
+    unsigned char header;
+    uint64_t length;
+    message * msg;
+    // Parent request, removed from the list once its block has been sent.
+    file_request * req;
+    uint32_t session_id;
+    uint64_t o_l[2];
+    char * path;
+    struct statx stx;
+    unsigned char * out;
+    uint64_t out_len;
+    // File bytes read so far by the current chain.
+    uint64_t got;
+    // Dictionary kept for the current message until its response is under way.
+    dictionary * dict;
+    // Shared listing being sent, given back once the next message arrives.
+    listing * listing;
+} uring_conn;
+
+static int ring_setup(uring * r) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    r->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (r->fd < 0) {
+        return -1;
+    }
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if ((p.features & IORING_FEAT_SINGLE_MMAP) && cq_size > sq_size) {
+        sq_size = cq_size;
+    }
+    char * sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        r->fd, IORING_OFF_SQ_RING);
+    char * cq = sq;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            r->fd, IORING_OFF_CQ_RING);
+    }
+    r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || r->sqes == MAP_FAILED) {
+        close(r->fd);
+        return -1;
+    }
+    r->sq_head = (unsigned *) (sq + p.sq_off.head);
+    r->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    r->sq_array = (unsigned *) (sq + p.sq_off.array);
+    r->sq_mask = *(unsigned *) (sq + p.sq_off.ring_mask);
+    r->sq_entries = p.sq_entries;
+    r->cq_head = (unsigned *) (cq + p.cq_off.head);
+    r->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    r->cq_mask = *(unsigned *) (cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+    // Submission slots map one to one onto the SQE array.
+    for (unsigned i = 0; i < p.sq_entries; i++) {
+        r->sq_array[i] = i;
+    }
+    r->tail = *r->sq_tail;
+    r->queued = 0;
+    r->multishot = 1;
+    // Register an empty file table, filled by direct opens of requested files.
+    struct io_uring_rsrc_register rr;
+    memset(&rr, 0, sizeof(rr));
+    rr.nr = URING_FILES;
+    rr.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_FILES2, &rr, sizeof(rr)) < 0) {
+        close(r->fd);
+        return -1;
+    }
+    for (int i = 0; i < URING_FILES; i++) {
+        r->slots[i] = URING_FILES - 1 - i;
+    }
+    r->free_slots = URING_FILES;
+    return 0;
+}
+/*
+    Publish queued submissions and enter the kernel, waiting for at least wait completions.
+*/
+static int ring_submit(uring * r, unsigned wait) {
+    __atomic_store_n(r->sq_tail, r->tail, __ATOMIC_RELEASE);
+    int ret = syscall(__NR_io_uring_enter, r->fd, r->queued, wait,
+        wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (ret >= 0) {
+        r->queued = 0;
+    }
+    return ret;
+}
+/*
+    Make room for a chain of n submissions, so it is handed to the kernel in one batch.
+*/
+static void ring_reserve(uring * r, unsigned n) {
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    if (r->tail - head + n > r->sq_entries) {
+        ring_submit(r, 0);
+    }
+}
+static struct io_uring_sqe * ring_sqe(uring * r, uring_conn * c, int op) {
+    ring_reserve(r, 1);
+    struct io_uring_sqe * sqe = &r->sqes[r->tail & r->sq_mask];
+    r->tail++;
+    r->queued++;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = (uint64_t) (uintptr_t) c | op;
+    if (c != NULL) {
+        c->inflight++;
+    }
+    return sqe;
+}
+static void arm_accept(uring * r, int serversock) {
+    struct io_uring_sqe * sqe = ring_sqe(r, NULL, OP_ACCEPT);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = serversock;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->ioprio = r->multishot ? IORING_ACCEPT_MULTISHOT : 0;
+}
+static void recv_into(uring * r, uring_conn * c, int op, void * buf, uint32_t len, int flags) {
+    struct io_uring_sqe * sqe = ring_sqe(r, c, op);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = c->fd;
+    sqe->addr = (uint64_t) (uintptr_t) buf;
+    sqe->len = len;
+    sqe->msg_flags = flags;
+}
+/*
+    Queue a send of buf, split into chunks the SQE can describe. Every chunk but the
+    last is linked, link decides whether the chain continues past the final chunk.
+*/
+static void send_from(uring * r, uring_conn * c, unsigned char * buf, uint64_t len, int link) {
+    do {
+        uint64_t n = len > URING_CHUNK ? URING_CHUNK : len;
+        struct io_uring_sqe * sqe = ring_sqe(r, c, OP_SEND);
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = c->fd;
+        sqe->addr = (uint64_t) (uintptr_t) buf;
+        sqe->len = n;
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        buf += n;
+        len -= n;
+        if (len > 0 || link) {
+            sqe->flags |= IOSQE_IO_LINK;
+        }
+    } while (len > 0);
+}
+/*
+    Wait for the next message header.
+*/
+static void next_message(uring * r, uring_conn * c) {
+    if (c->dict != NULL) {
+        dictionary_put(c->dict);
+        c->dict = NULL;
+    }
+    recv_into(r, c, OP_HEADER, &c->header, 1, 0);
+}
+/*
+    Queue a response frame, followed by a linked receive of the next message header,
+    unless the connection closes once the frame has been sent.
+*/
+static void respond(uring * r, uring_conn * c, unsigned char header, unsigned char * payload, uint64_t length) {
+    free(c->out);
+    c->out_len = length + 9;
+    c->out = malloc(c->out_len);
+    c->out[0] = header;
+    uint64_t be = bswap_64(length);
+    memcpy(c->out + 1, &be, 8);
+    if (length > 0) {
+        memcpy(c->out + 9, payload, length);
+    }
+    ring_reserve(r, URING_CHAIN);
+    send_from(r, c, c->out, c->out_len, !c->last);
+    if (!c->last) {
+        next_message(r, c);
+    }
+}
+/*
+    Compress the message payload (in place) and respond with it.
+*/
+static void respond_compressed(uring * r, uring_conn * c, unsigned char header, message * msg, m_node ** dict) {
+    compress(&msg, dict);
+    respond(r, c, header, msg->buffer, msg->length);
+}
+static void respond_error(uring * r, uring_conn * c, int last) {
+    c->last = last;
+    respond(r, c, 0b11110000, NULL, 0);
+}
+/*
+    Stop using a connection. Pending operations are woken by the socket shutdown,
+    and the connection is released once the last of them completes.
+*/
+static void conn_close(uring_conn * c) {
+    c->closing = 1;
+    shutdown(c->fd, SHUT_RDWR);
+}
+static void conn_release(uring * r, uring_conn * c, thread_pool * tp) {
+    if (c->req != NULL) {
+        remove_node(&tp->requests_list, c->req);
+    }
+    if (c->msg != NULL) {
+        free(c->msg->buffer);
+        free(c->msg);
+    }
+    if (c->slot >= 0) {
+        r->slots[r->free_slots++] = c->slot;
+    }
+    if (c->dict != NULL) {
+        dictionary_put(c->dict);
+    }
+    if (c->listing != NULL) {
+        dirindex_release(c->listing);
+    }
+    close(c->fd);
+    free(c->path);
+    free(c->out);
+    free(c);
+}
+/*
+    Queue the file read of a block as one linked chain: direct open into a fixed file slot,
+    read at the block offset, close of the slot and (uncompressed) the send of the frame.
+    The frame is laid out in front of the read buffer, so the file data is never copied.
+*/
+static void read_block(uring * r, uring_conn * c, uint64_t offset, uint64_t length) {
+    if (r->free_slots == 0) {
+        // Every fixed slot is in use, turn the request away rather than block the ring.
+        respond_error(r, c, c->last);
+        return;
+    }
+    c->slot = r->slots[--r->free_slots];
+    c->got = 0;
+    free(c->out);
+    c->out_len = 9 + 20 + length;
+    c->out = malloc(c->out_len);
+    c->out[0] = 0b01110000;
+    uint64_t be = bswap_64(20 + length);
+    memcpy(c->out + 1, &be, 8);
+    segment_header(c->out + 9, c->session_id, offset, length);
+    ring_reserve(r, URING_CHAIN);
+    struct io_uring_sqe * sqe = ring_sqe(r, c, OP_OPEN);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t) (uintptr_t) c->path;
+    sqe->open_flags = O_RDONLY;
+    sqe->file_index = c->slot + 1;
+    sqe->flags = IOSQE_IO_LINK;
+    uint64_t done = 0;
+    do {
+        uint64_t n = length - done > URING_CHUNK ? URING_CHUNK : length - done;
+        sqe = ring_sqe(r, c, OP_READ);
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = c->slot;
+        sqe->addr = (uint64_t) (uintptr_t) (c->out + 29 + done);
+        sqe->len = n;
+        sqe->off = offset + done;
+        sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+        done += n;
+    } while (done < length);
+    sqe = ring_sqe(r, c, OP_CLOSE);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = c->slot + 1;
+    if (c->compressed) {
+        // Compression runs on the read data once the chain completes.
+        return;
+    }
+    sqe->flags = IOSQE_IO_LINK;
+    send_from(r, c, c->out, c->out_len, !c->last);
+    if (!c->last) {
+        next_message(r, c);
+    }
+}
+static void on_statx(uring * r, uring_conn * c, thread_pool * tp, int res);
+/*
+    Find the size of the file at c->path and complete in on_statx. The directory index
+    answers straight away where it can, otherwise a STATX is submitted.
+*/
+static void stat_file(uring * r, uring_conn * c, thread_pool * tp, const char * name) {
+    uint64_t size;
+    int known = dirindex_lookup(name, &size);
+    if (known != -1) {
+        c->stx.stx_size = size;
+        on_statx(r, c, tp, known ? 0 : -ENOENT);
+        return;
+    }
+    struct io_uring_sqe * sqe = ring_sqe(r, c, OP_STATX);
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t) (uintptr_t) c->path;
+    sqe->len = STATX_SIZE;
+    sqe->off = (uint64_t) (uintptr_t) &c->stx;
+}
+/*
+    Handle a retrieval message, as parent (first connection for the session) or child.
+*/
+static void file_retrieval(uring * r, uring_conn * c, thread_pool * tp) {
+    file_request * req = dissect_file_request(c->msg);
+    c->compressed = c->msg->main.requires_compression;
+    c->session_id = req->session_id;
+    free(c->path);
+    c->path = file_path(tp->data.directory, (char *) req->file_name);
+    file_request * curr = find(&tp->requests_list, req);
+    if (curr != NULL) {
+        // Child: wait (asynchronously) for the parent to hand over its block.
+        c->last = 1;
+        if (c->path == NULL || strcmp((char *) req->file_name, (char *) curr->file_name) != 0 ||
+            req->length != curr->length || req->offset != curr->offset) {
+            respond_error(r, c, 1);
+        }
+        else {
+            pthread_mutex_lock(&curr->node_lock);
+            curr->num_connect++;
+            pthread_mutex_unlock(&curr->node_lock);
+            struct io_uring_sqe * sqe = ring_sqe(r, c, OP_PIPE);
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = curr->pipefd[0];
+            sqe->addr = (uint64_t) (uintptr_t) c->o_l;
+            sqe->len = 16;
+            sqe->off = (uint64_t) -1;
+        }
+        free(req->file_name);
+        free(req);
+        return;
+    }
+    // Parent: register the request, then check the range against the file size.
+    pipe(req->pipefd);
+    pthread_mutex_init(&req->node_lock, NULL);
+    req->num_connect = 0;
+    add(&tp->requests_list, req);
+    c->req = req;
+    if (c->path == NULL) {
+        remove_node(&tp->requests_list, req);
+        c->req = NULL;
+        respond_error(r, c, 0);
+        return;
+    }
+    stat_file(r, c, tp, (char *) req->file_name);
+}
+/*
+    A complete message has been received, dispatch it on its type.
+    Returns 1 when the message shut the server down.
+*/
+static int dispatch(uring * r, uring_conn * c, thread_pool * tp) {
+    message * msg = c->msg;
+    // The next header is only received once a response has been sent, so it is done with.
+    if (c->listing != NULL) {
+        dirindex_release(c->listing);
+        c->listing = NULL;
+    }
+    if (c->dict != NULL) {
+        dictionary_put(c->dict);
+    }
+    c->dict = dictionary_hold();
+    m_node ** dict = &c->dict->map;
+    decode_payload(msg, dict);
+    if (msg->main.type == 0x0) {
+        // Echo, compressing where required and not already compressed.
+        if (msg->main.requires_compression == 1 && msg->main.compression == 0) {
+            respond_compressed(r, c, 0b00011000, msg, dict);
+        }
+        else if (msg->main.requires_compression == 1) {
+            respond(r, c, 0b00011000, msg->buffer, msg->length);
+        }
+        else {
+            respond(r, c, 0b00010000, msg->buffer, msg->length);
+        }
+    }
+    else if (msg->main.type == 0x2) {
+        // The index's ready listing is sent as it is, kept until the send is over.
+        int compressed = msg->main.requires_compression == 1;
+        c->listing = dirindex_listing(compressed, dict);
+        if (c->listing != NULL) {
+            ring_reserve(r, URING_CHAIN);
+            send_from(r, c, c->listing->frame[compressed], c->listing->length[compressed], !c->last);
+            if (!c->last) {
+                next_message(r, c);
+            }
+        }
+        else {
+            message list;
+            list.buffer = directory_list(tp->data.directory, &list.length);
+            if (compressed) {
+                respond_compressed(r, c, 0b00111000, &list, dict);
+            }
+            else {
+                respond(r, c, 0b00110000, list.buffer, list.length);
+            }
+            free(list.buffer);
+        }
+    }
+    else if (msg->main.type == 0x4) {
+        free(c->path);
+        c->path = msg->buffer ? file_path(tp->data.directory, (char *) msg->buffer) : NULL;
+        // The STATX completion needs the compression setting once the message is gone.
+        c->compressed = msg->main.requires_compression;
+        if (c->path == NULL) {
+            respond_error(r, c, 0);
+        }
+        else {
+            stat_file(r, c, tp, (char *) msg->buffer);
+        }
+    }
+    else if (msg->main.type == 0x6 && msg->length <= 20) {
+        respond_error(r, c, 0);
+    }
+    else if (msg->main.type == 0x6) {
+        file_retrieval(r, c, tp);
+    }
+    free(c->msg->buffer);
+    free(c->msg);
+    c->msg = NULL;
+    return 0;
+}
+/*
+    Handle the header byte of a new message.
+*/
+static int on_header(uring * r, uring_conn * c, thread_pool * tp) {
+    unsigned type = c->header >> 4;
+    if (type == 0x8) {
+        conn_close(c);
+        shutter(tp);
+        return 1;
+    }
+    if (type != 0 && type != 2 && type != 4 && type != 6) {
+        respond_error(r, c, 1);
+        return 0;
+    }
+    c->msg = malloc(sizeof(message));
+    c->msg->buffer = NULL;
+    c->msg->main.type = type;
+    c->msg->main.compression = (c->header >> 3);
+    c->msg->main.requires_compression = (c->header >> 2);
+    recv_into(r, c, OP_LENGTH, &c->length, 8, MSG_WAITALL);
+    return 0;
+}
+/*
+    The size of the file for a size or retrieval message is known, from the index or a STATX.
+*/
+static void on_statx(uring * r, uring_conn * c, thread_pool * tp, int res) {
+    if (c->req == NULL) {
+        // File size message.
+        if (res < 0) {
+            respond_error(r, c, 0);
+            return;
+        }
+        uint64_t size = bswap_64(c->stx.stx_size);
+        if (!c->compressed) {
+            respond(r, c, 0b01010000, (unsigned char *) &size, 8);
+            return;
+        }
+        message msg;
+        msg.length = 8;
+        msg.buffer = malloc(8);
+        memcpy(msg.buffer, &size, 8);
+        respond_compressed(r, c, 0b01011000, &msg, &c->dict->map);
+        free(msg.buffer);
+        return;
+    }
+    file_request * req = c->req;
+    if (res < 0 || req->offset > c->stx.stx_size || req->offset + req->length > c->stx.stx_size) {
+        remove_node(&tp->requests_list, req);
+        c->req = NULL;
+        respond_error(r, c, 0);
+        return;
+    }
+    uint64_t offset = 0;
+    uint64_t division = split_request(req, &offset);
+    read_block(r, c, offset, division);
+}
+/*
+    The file read chain has completed, compress the block and send it.
+*/
+static void on_block(uring * r, uring_conn * c) {
+    message msg;
+    msg.length = c->out_len - 9;
+    msg.buffer = malloc(msg.length);
+    memcpy(msg.buffer, c->out + 9, msg.length);
+    respond_compressed(r, c, 0b01111000, &msg, &c->dict->map);
+    free(msg.buffer);
+}
+static void on_completion(uring * r, struct io_uring_cqe * cqe, thread_pool * tp, int * stop) {
+    uring_conn * c = (uring_conn *) (uintptr_t) (cqe->user_data & ~(uint64_t) OP_MASK);
+    int op = cqe->user_data & OP_MASK;
+    int res = cqe->res;
+    if (op == OP_ACCEPT) {
+        if (res >= 0) {
+            uring_conn * n = calloc(1, sizeof(uring_conn));
+            n->fd = res;
+            n->slot = -1;
+            next_message(r, n);
+        }
+        else if (res == -EINVAL && r->multishot) {
+            // Multishot accept is not supported by this kernel.
+            r->multishot = 0;
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE) && tp->shut == 0) {
+            arm_accept(r, tp->serversock);
+        }
+        return;
+    }
+    c->inflight--;
+    if (c->closing) {
+        if (c->inflight == 0) {
+            conn_release(r, c, tp);
+        }
+        return;
+    }
+    switch (op) {
+        case OP_HEADER:
+            if (res <= 0) {
+                if (!c->failed) {
+                    conn_close(c);
+                }
+            }
+            else {
+                *stop = on_header(r, c, tp);
+            }
+            break;
+        case OP_LENGTH:
+            if (res != 8) {
+                conn_close(c);
+                break;
+            }
+            c->msg->length = bswap_64(c->length);
+            if (c->msg->length == 0) {
+                *stop = dispatch(r, c, tp);
+            }
+            else if (c->msg->length > URING_CHUNK) {
+                conn_close(c);
+            }
+            else {
+                c->msg->buffer = malloc(c->msg->length);
+                recv_into(r, c, OP_BODY, c->msg->buffer, c->msg->length, MSG_WAITALL);
+            }
+            break;
+        case OP_BODY:
+            if (res < 0 || (uint64_t) res != c->msg->length) {
+                conn_close(c);
+                break;
+            }
+            *stop = dispatch(r, c, tp);
+            break;
+        case OP_STATX:
+            on_statx(r, c, tp, res);
+            break;
+        case OP_PIPE:
+            if (res != 16) {
+                conn_close(c);
+                break;
+            }
+            read_block(r, c, c->o_l[0], c->o_l[1]);
+            break;
+        case OP_OPEN:
+            if (res < 0) {
+                c->failed = 1;
+            }
+            break;
+        case OP_READ:
+            if (res < 0) {
+                c->failed = 1;
+            }
+            else {
+                c->got += res;
+            }
+            break;
+        case OP_CLOSE:
+            // A short read breaks the link, so the chain is checked as a whole here.
+            if (c->got != c->out_len - 29) {
+                c->failed = 1;
+            }
+            r->slots[r->free_slots++] = c->slot;
+            c->slot = -1;
+            if (!c->failed && c->compressed) {
+                on_block(r, c);
+            }
+            break;
+        case OP_SEND:
+            if (c->failed) {
+                break;
+            }
+            if (res < 0) {
+                conn_close(c);
+                break;
+            }
+            if (c->req != NULL) {
+                // The parent's block has gone out, the session is finished.
+                remove_node(&tp->requests_list, c->req);
+                c->req = NULL;
+            }
+            if (c->last && c->inflight == 0) {
+                conn_close(c);
+            }
+            break;
+    }
+    if (c->closing && c->inflight == 0) {
+        conn_release(r, c, tp);
+    }
+    else if (c->failed && c->inflight == 0) {
+        // Every operation in the failed chain has completed, report the error to the client.
+        c->failed = 0;
+        if (c->req != NULL) {
+            remove_node(&tp->requests_list, c->req);
+            c->req = NULL;
+        }
+        respond_error(r, c, c->last);
+    }
+}
+/*
+    Run the server on an io_uring instance, in place of the accept loop and thread pool.
+    Accepts with a multishot accept on the server socket, and submits receives, file
+    opens, reads and sends in batches, one io_uring_enter per pass of the loop.
+    Returns -1 when io_uring is unavailable, and 0 once the server has been shut down.
+*/
+int uring_run(thread_pool * tp) {
+    uring * r = malloc(sizeof(uring));
+    if (ring_setup(r) == -1) {
+        perror("io_uring setup failed");
+        free(r);
+        return -1;
+    }
+    arm_accept(r, tp->serversock);
+    int stop = 0;
+    while (!stop) {
+        if (ring_submit(r, 1) < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+            perror("io_uring_enter failed");
+            break;
+        }
+        unsigned head = *r->cq_head;
+        unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail && !stop) {
+            on_completion(r, &r->cqes[head & r->cq_mask], tp, &stop);
+            head++;
+            __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+            if (head == tail) {
+                tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+            }
+        }
+    }
+    close(r->fd);
+    free(r);
+    return 0;
+}
\ No newline at end of file
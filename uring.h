@@ -0,0 +1,5 @@
+#ifndef URING_H
+#define URING_H
+#include "tp.h"
+int uring_run(thread_pool * tp);
+#endif
\ No newline at end of file